@@ -9,6 +9,8 @@ using namespace std;
 
 #include "bagel.h"
 using namespace bagel;
+template <> struct bagel::BitWidth<pong::Intent> : std::integral_constant<int, 2> {};
+template <> struct bagel::Storage<pong::Scorer> { using type = HashStorage<pong::Scorer>; };
 
 namespace pong
 {
@@ -141,66 +143,16 @@ namespace pong
 		);
 	}
 
-	class InputSystem
-	{
-	public:
-		void update() {
-			for (int i = 0; i < _entities.size(); ++i) {
-				ent_type e = _entities[i];
-				if (!World::mask(e).test(mask)) {
-					_entities[i] = _entities[_entities.size()-1];
-					_entities.pop();
-					--i;
-					continue;
-				}
-			}
-		}
-		void updateEntities() {
-			for (int i = 0; i < World::sizeAdded(); ++i) {
-				const AddedMask& am = World::getAdded(i);
-
-				if ((!am.prev.test(mask)) && (am.next.test(mask))) {
-					_entities.push(am.e);
-				}
-			}
-		}
-
-		InputSystem()
-		{
-			for (ent_type e{0}; e.id <= World::maxId().id; ++e.id) {
-				if (World::mask(e).test(mask)) {
-					_entities.push(e);
-				}
-			}
-		}
-	private:
-		Bag<ent_type,100> _entities;
-
-		static const inline Mask mask = MaskBuilder()
-				.set<Keys>()
-				.set<Intent>()
-				.build();
-	};
-
 	void Pong::input_system() const
 	{
-		static const Mask mask = MaskBuilder()
-			.set<Keys>()
-			.set<Intent>()
-			.build();
+		static ReactiveSystem<TypeList<Keys,Intent>> players;
 
 		SDL_PumpEvents();
 		const bool* keys = SDL_GetKeyboardState(nullptr);
 
-		for (ent_type e{0}; e.id <= World::maxId().id; ++e.id) {
-			if (World::mask(e).test(mask)) {
-				const Keys& k = World::getComponent<Keys>(e);
-				Intent& i = World::getComponent<Intent>(e);
-
-				i.up = keys[k.up];
-				i.down = keys[k.down];
-			}
-		}
+		players.each([keys](ent_type, const Keys& k, auto i) {
+			i = Intent{keys[k.up], keys[k.down]};
+		});
 	}
 	void Pong::move_system() const
 	{
@@ -243,11 +195,16 @@ namespace pong
 	{
 		const auto se = b2World_GetSensorEvents(boxWorld);
 		for (int i = 0; i < se.endCount; ++i) {
-			// score, recreate ball
+			// score, recreate ball; a ball leaving both sensors is scored once
+			if (!b2Shape_IsValid(se.endEvents[i].visitorShapeId))
+				continue;
 			b2BodyId b = b2Shape_GetBody(se.endEvents[i].visitorShapeId);
 			ent_type *e = static_cast<ent_type*>(b2Body_GetUserData(b));
+			if (e == nullptr || !World::valid(*e))
+				continue;
 			World::destroyEntity(*e);
 			b2DestroyBody(b);
+			delete e;
 
 			createBall();
 		}
@@ -314,21 +271,12 @@ namespace pong
 		auto start = SDL_GetTicks();
 		bool quit = false;
 
-		InputSystem is;
 		while (!quit) {
-			is.updateEntities();
-			//first updateEntities() for all systems
-
-			is.update();
-			//then update() for all systems
-
-			World::step();
-			//finally World::step() to clear added() array
-
-			//input_system();
+			input_system();
 			move_system();
 			box_system();
 			score_system();
+			World::step();
 
 			draw_system();
 
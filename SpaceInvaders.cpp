@@ -5,11 +5,14 @@
 #include "SpaceInvadersConfig.h"
 #include <iostream>
 #include <random>
+#include <vector>
 
 namespace SpaceInvadersGame {
 
     static int invaderMoveInterval = INVADER_MOVE_INTERVAL;
     static int enemyShootPropability = ENEMY_SHOOT_PROPABILITY;
+    // structural changes made while iterating are recorded here and applied after the loop
+    static bagel::CommandBuffer commands;
 
 void whenEnemyDies()
 {
@@ -39,17 +42,10 @@ int getRandomNumber(int n) {
  * Required: Position, Velocity
  */
 void MovementSystem() {
-    for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (!bagel::World::mask(ent).test(bagel::Component<Position>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Velocity>::Bit)) {
-            continue;
-        }
-        Position& pos = bagel::World::getComponent<Position>(ent);
-        const Velocity& vel = bagel::World::getComponent<Velocity>(ent);
+    bagel::World::view<Position, Velocity>().parallelEach([](bagel::ent_type, Position& pos, const Velocity& vel) {
         pos.x += vel.x;
         pos.y += vel.y;
-    }
+    });
 }
 
 /**
@@ -61,13 +57,13 @@ void RenderSystem(SDL_Renderer* renderer, SDL_Texture* gInvaderTexture, SDL_Text
 
     SDL_RenderClear(renderer);
 
+    constexpr bagel::Mask projectile = bagel::MaskBuilder().set<ProjectileTag>().build();
+
     // Draw player
+    constexpr bagel::Mask player = bagel::MaskBuilder().set<PlayerTag>().set<Position>().set<RenderData>().build();
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (!bagel::World::mask(ent).test(bagel::Component<PlayerTag>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Position>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<RenderData>::Bit) ||
-            bagel::World::mask(ent).test(bagel::Component<ProjectileTag>::Bit)) {
+        const bagel::ent_type ent = bagel::World::entity(id);
+        if (!bagel::World::mask(ent).test(player) || bagel::World::mask(ent).any(projectile)) {
             continue;
         }
         const Position& pos = bagel::World::getComponent<Position>(ent);
@@ -79,13 +75,11 @@ void RenderSystem(SDL_Renderer* renderer, SDL_Texture* gInvaderTexture, SDL_Text
     }
 
     // Draw invaders
+    constexpr bagel::Mask invader = bagel::MaskBuilder().set<EnemyTag>().set<Position>().set<RenderData>()
+        .set<PostureChanger>().build();
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (!bagel::World::mask(ent).test(bagel::Component<EnemyTag>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Position>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<RenderData>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<PostureChanger>::Bit) ||
-            bagel::World::mask(ent).test(bagel::Component<ProjectileTag>::Bit)) {
+        const bagel::ent_type ent = bagel::World::entity(id);
+        if (!bagel::World::mask(ent).test(invader) || bagel::World::mask(ent).any(projectile)) {
             continue;
         }
 
@@ -100,10 +94,10 @@ void RenderSystem(SDL_Renderer* renderer, SDL_Texture* gInvaderTexture, SDL_Text
     }
 
     // Draw projectiles
+    constexpr bagel::Mask shot = bagel::MaskBuilder().set<ProjectileTag>().set<Position>().build();
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (!bagel::World::mask(ent).test(bagel::Component<ProjectileTag>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Position>::Bit)) {
+        const bagel::ent_type ent = bagel::World::entity(id);
+        if (!bagel::World::mask(ent).test(shot)) {
             continue;
         }
         const Position& pos = bagel::World::getComponent<Position>(ent);
@@ -150,26 +144,23 @@ bool IsEntityOutOfView(bagel::ent_type ent){
 void ChangeEnemyPostureSystem()
     {
         static int step = 1;
-        for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-            bagel::ent_type ent{id};
-            if (!bagel::World::mask(ent).test(bagel::Component<PostureChanger>::Bit))
-                continue;
-            PostureChanger& post = bagel::World::getComponent<PostureChanger>(ent);
-            if (step == 0) {
+        if (step == 0) {
+            bagel::World::view<PostureChanger>().each([](bagel::ent_type, PostureChanger& post) {
                 post.postureId = (post.postureId + 1) % NUM_OF_INVADERS_POSTURES_PER_TYPE;
-            }
+            });
         }
         step = (step + 1) % CHANGE_INVADERS_POSTURE_SPEED;
     }
 
 void DeleteOffscreenEntitiesSystem(){
         for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-            bagel::ent_type ent{id};
+            const bagel::ent_type ent = bagel::World::entity(id);
             if (IsEntityOutOfView(ent) &&
                 bagel::World::mask(ent).test(bagel::Component<ProjectileTag>::Bit)){
                 //std::cerr << id << " Entity out of view!" << std::endl;
-                bagel::World::addComponent(ent, Dead{});
+                commands.add(ent, Dead{});
             }}
+        commands.playback();
     }
 /**
  * @brief Detects and handles collisions between entities.
@@ -177,22 +168,19 @@ void DeleteOffscreenEntitiesSystem(){
  * Optional: Health, ScoreValue, Dead
  */
 void CollisionSystem() {
-    for (bagel::id_type id1 = 0; id1 <= bagel::World::maxId().id; ++id1) {
-        bagel::ent_type ent1{id1};
-        if (!bagel::World::mask(ent1).test(bagel::Component<Position>::Bit) ||
-            !bagel::World::mask(ent1).test(bagel::Component<Collider>::Bit)) {
-            continue;
-        }
-        const Position& pos1 = bagel::World::getComponent<Position>(ent1);
-        const Collider& col1 = bagel::World::getComponent<Collider>(ent1);
-        for (bagel::id_type id2 = id1 + 1; id2 <= bagel::World::maxId().id; ++id2) {
-            bagel::ent_type ent2{id2};
-            if (!bagel::World::mask(ent2).test(bagel::Component<Position>::Bit) ||
-                !bagel::World::mask(ent2).test(bagel::Component<Collider>::Bit)) {
-                continue;
-            }
-            const Position& pos2 = bagel::World::getComponent<Position>(ent2);
-            const Collider& col2 = bagel::World::getComponent<Collider>(ent2);
+    // Position and Collider are co-sorted by the group, so both loops walk parallel arrays
+    auto colliders = bagel::World::group<Position, Collider>();
+    const bagel::Span<const bagel::ent_type> ents = colliders.entities();
+    const bagel::Span<Position> positions = colliders.components<Position>();
+    const bagel::Span<Collider> boxes = colliders.components<Collider>();
+    for (bagel::index_type i1 = 0; i1 < ents.size; ++i1) {
+        const bagel::ent_type ent1 = ents[i1];
+        const Position& pos1 = positions[i1];
+        const Collider& col1 = boxes[i1];
+        for (bagel::index_type i2 = i1 + 1; i2 < ents.size; ++i2) {
+            const bagel::ent_type ent2 = ents[i2];
+            const Position& pos2 = positions[i2];
+            const Collider& col2 = boxes[i2];
             if (pos1.x < pos2.x + col2.width &&
                 pos1.x + col1.width > pos2.x &&
                 pos1.y < pos2.y + col2.height &&
@@ -206,19 +194,20 @@ void CollisionSystem() {
                     Health& health1 = bagel::World::getComponent<Health>(ent1);
                     health1.hp--;
                     if (health1.hp <= 0) {
-                        bagel::World::addComponent(ent1, Dead{});
+                        commands.add(ent1, Dead{});
                     }
                 }
                 if (bagel::World::mask(ent2).test(bagel::Component<Health>::Bit)) {
                     Health& health2 = bagel::World::getComponent<Health>(ent2);
                     health2.hp--;
                     if (health2.hp <= 0) {
-                        bagel::World::addComponent(ent2, Dead{});
+                        commands.add(ent2, Dead{});
                     }
                 }
             }
         }
     }
+    commands.playback();
 }
 
 /**
@@ -228,20 +217,19 @@ void CollisionSystem() {
 void PlayerShootingSystem() {
     bool playerBulletExists = false;
 
+    constexpr bagel::Mask playerBullet = bagel::MaskBuilder().set<ProjectileTag>().set<PlayerProjectileTag>().build();
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (bagel::World::mask(ent).test(bagel::Component<ProjectileTag>::Bit) &&
-            bagel::World::mask(ent).test(bagel::Component<PlayerProjectileTag>::Bit)) {
+        const bagel::ent_type ent = bagel::World::entity(id);
+        if (bagel::World::mask(ent).test(playerBullet)) {
             playerBulletExists = true;
             break;
         }
     }
 
+    constexpr bagel::Mask shooter = bagel::MaskBuilder().set<PlayerTag>().set<Input>().set<Position>().build();
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (!bagel::World::mask(ent).test(bagel::Component<PlayerTag>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Input>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Position>::Bit)) {
+        const bagel::ent_type ent = bagel::World::entity(id);
+        if (!bagel::World::mask(ent).test(shooter)) {
             continue;
         }
         const Input& input = bagel::World::getComponent<Input>(ent);
@@ -263,14 +251,14 @@ void PlayerShootingSystem() {
  */
 void EnemyShootingSystem() {
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
+        const bagel::ent_type ent = bagel::World::entity(id);
         if (!bagel::World::mask(ent).test(bagel::Component<EnemyTag>::Bit) ||
             !bagel::World::mask(ent).test(bagel::Component<Position>::Bit) ||
             !bagel::World::mask(ent).test(bagel::Component<Shoots>::Bit)) {
             continue;
         }
         const Position& pos = bagel::World::getComponent<Position>(ent);
-        const Shoots& shoots = bagel::World::getComponent<Shoots>(ent);
+        const Shoots shoots = bagel::World::getComponent<Shoots>(ent);
 
         if (shoots.value) {
             // Fire a bullet from the center bottom of the enemy
@@ -289,16 +277,17 @@ void EnemyShootingSystem() {
  */
 void HealthSystem() {
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
+        const bagel::ent_type ent = bagel::World::entity(id);
         if (bagel::World::mask(ent).test(bagel::Component<Dead>::Bit)) {
             if (bagel::World::mask(ent).test(bagel::Component<EnemyTag>::Bit))
                 whenEnemyDies();
             else if (bagel::World::mask(ent).test(bagel::Component<PlayerTag>::Bit))
                 std::cerr << "Player dead" << std::endl;
-            bagel::World::destroyEntity(ent);
+            commands.destroy(ent);
             std::cout << id << " Entity Destroyed" << std::endl;
         }
     }
+    commands.playback();
 }
 
 /**
@@ -308,7 +297,7 @@ void HealthSystem() {
 void ScoreSystem() {
     static int score = 0;
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
+        const bagel::ent_type ent = bagel::World::entity(id);
         if (bagel::World::mask(ent).test(bagel::Component<Dead>::Bit) &&
             bagel::World::mask(ent).test(bagel::Component<ScoreValue>::Bit)) {
             const ScoreValue& scoreVal = bagel::World::getComponent<ScoreValue>(ent);
@@ -332,7 +321,7 @@ void EnemyLogicSystem() {
         invaderMoveCounter = 0;
         float minX = 800.0f, maxX = 0.0f;
         for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-            bagel::ent_type ent{id};
+            const bagel::ent_type ent = bagel::World::entity(id);
             if (!bagel::World::mask(ent).test(bagel::Component<EnemyTag>::Bit) ||
                 !bagel::World::mask(ent).test(bagel::Component<Position>::Bit)) {
                 continue;
@@ -347,7 +336,7 @@ void EnemyLogicSystem() {
         if (minX < 10.0f || maxX > 790.0f) {
             invaderDir *= -1;
             for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-                bagel::ent_type ent{id};
+                const bagel::ent_type ent = bagel::World::entity(id);
                 if (!bagel::World::mask(ent).test(bagel::Component<EnemyTag>::Bit) ||
                     !bagel::World::mask(ent).test(bagel::Component<Position>::Bit)) {
                     continue;
@@ -358,20 +347,19 @@ void EnemyLogicSystem() {
         }
     }
 
-    // Random shooting for enemies
-    for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (!bagel::World::mask(ent).test(bagel::Component<EnemyTag>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Position>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Shoots>::Bit)) {
-            continue;
-        }
-        Shoots& shoots = bagel::World::getComponent<Shoots>(ent);
-        if (rand() % enemyShootPropability == 0) {
-            shoots.value = true;
-        } else {
-            shoots.value = false;
+    // Random shooting for enemies, 64 ids per word of Shoots flags
+    bagel::Span<bagel::word_type> shoots = bagel::BitStorage<Shoots>::plane(0);
+    for (bagel::index_type w = 0; w < shoots.size; ++w) {
+        const bagel::word_type invaders =
+            bagel::World::bitWord(bagel::Component<EnemyTag>::Index, w) &
+            bagel::World::bitWord(bagel::Component<Position>::Index, w) &
+            bagel::World::bitWord(bagel::Component<Shoots>::Index, w);
+        bagel::word_type fire = 0;
+        for (bagel::word_type rest = invaders; rest != 0; rest &= rest - 1) {
+            if (rand() % enemyShootPropability == 0)
+                fire |= rest & (~rest + 1);
         }
+        shoots[w] = (shoots[w] & ~invaders) | fire;
     }
 }
 
@@ -380,13 +368,7 @@ void EnemyLogicSystem() {
  * Required: PlayerTag, Input
  */
 void PlayerIntentSystem() {
-    for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
-        if (!bagel::World::mask(ent).test(bagel::Component<PlayerTag>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Input>::Bit) ||
-            !bagel::World::mask(ent).test(bagel::Component<Velocity>::Bit)) {
-            continue;
-        }
+    for (bagel::ent_type ent : bagel::World::view<PlayerTag, Input, Velocity>()) {
         const Input& input = bagel::World::getComponent<Input>(ent);
         Velocity& vel = bagel::World::getComponent<Velocity>(ent);
         vel.x = 0.0f;
@@ -401,7 +383,7 @@ void PlayerIntentSystem() {
  */
 void PlayerActionSystem() {
     for (bagel::id_type id = 0; id <= bagel::World::maxId().id; ++id) {
-        bagel::ent_type ent{id};
+        const bagel::ent_type ent = bagel::World::entity(id);
         if (!bagel::World::mask(ent).test(bagel::Component<PlayerTag>::Bit) ||
             !bagel::World::mask(ent).test(bagel::Component<Input>::Bit) ||
             !bagel::World::mask(ent).test(bagel::Component<Position>::Bit) ||
@@ -410,13 +392,13 @@ void PlayerActionSystem() {
         }
         const Input& input = bagel::World::getComponent<Input>(ent);
         const Position& pos = bagel::World::getComponent<Position>(ent);
-        Shoots& shoots = bagel::World::getComponent<Shoots>(ent);
+        const Shoots shoots = bagel::World::getComponent<Shoots>(ent);
         if (input.firePressed && !shoots.value) {
-            shoots.value = true;
+            bagel::World::getComponent<Shoots>(ent) = Shoots{true};
             // Create a projectile
             SpaceInvadersGame::CreateProjectileEntity(pos.x + 30.0f, pos.y, 0.0f, -8.0f, true);
         } else if (!input.firePressed) {
-            shoots.value = false;
+            bagel::World::getComponent<Shoots>(ent) = Shoots{false};
         }
     }
 }
@@ -465,6 +447,34 @@ int CreateEnemyEntity(float pos_x, float pos_y, int score) {
     return enemy.entity().id;
 }
 
+/**
+ * @brief Creates a rows x cols grid of enemies in one batch.
+ */
+void CreateEnemyGrid(float start_x, float start_y, int rows, int cols, int score) {
+    std::vector<bagel::ent_type> enemies(rows * cols);
+    bagel::World::createEntities({enemies.data(), rows * cols},
+        Position{},
+        Velocity{0.0f, 0.0f},
+        RenderData{0},
+        PostureChanger{0},
+        Collider{INVADER_WIDTH, INVADER_HEIGHT},
+        EnemyTag{},
+        Health{1},
+        ScoreValue{score},
+        Shoots{false},
+        EnemyPath{},
+        WantsToShoot{}
+    );
+    for (int row = 0; row < rows; ++row) {
+        for (int col = 0; col < cols; ++col) {
+            bagel::Entity enemy = enemies[row * cols + col];
+            enemy.get<Position>() = {start_x + col * (INVADER_WIDTH + INVADER_X_GAP),
+                                     start_y + row * (INVADER_HEIGHT + INVADER_Y_GAP)};
+            enemy.get<RenderData>().spriteId = row % NUM_OF_INVADERS_TYPES;
+        }
+    }
+}
+
 /**
  * @brief Creates a projectile entity.
  */
@@ -158,8 +158,30 @@ void PlayerActionSystem();
 
 int CreatePlayerEntity(float pos_x, float pos_y);
 int CreateEnemyEntity(float pos_x, float pos_y, int score);
+void CreateEnemyGrid(float start_x, float start_y, int rows, int cols, int score);
 int CreateProjectileEntity(float pos_x, float pos_y, float vel_x, float vel_y, bool isPlayer);
 int CreateExplosionEntity(float pos_x, float pos_y);
 int CreateWallEntity(float pos_x, float pos_y, float width, float height, int hp);
 
-} // namespace SpaceInvadersGame
\ No newline at end of file
+} // namespace SpaceInvadersGame
+
+// indices fixed at compile time, so system masks are constants
+using GameComponents = bagel::Components<
+    SpaceInvadersGame::Position, SpaceInvadersGame::Velocity, SpaceInvadersGame::Collider,
+    SpaceInvadersGame::Health, SpaceInvadersGame::PlayerTag, SpaceInvadersGame::EnemyTag,
+    SpaceInvadersGame::PlayerProjectileTag, SpaceInvadersGame::EnemyProjectileTag,
+    SpaceInvadersGame::ProjectileTag, SpaceInvadersGame::Shoots, SpaceInvadersGame::ScoreValue,
+    SpaceInvadersGame::RenderData, SpaceInvadersGame::PostureChanger, SpaceInvadersGame::Dead,
+    SpaceInvadersGame::Input, SpaceInvadersGame::EnemyPath, SpaceInvadersGame::WantsToShoot>;
+BAGEL_COMPONENTS(GameComponents);
+
+// Position and Collider are dense so CollisionSystem can own them in a group
+template <> struct bagel::Storage<SpaceInvadersGame::Position> {
+    using type = bagel::PackedStorage<SpaceInvadersGame::Position>;
+};
+template <> struct bagel::Storage<SpaceInvadersGame::Collider> {
+    using type = bagel::PackedStorage<SpaceInvadersGame::Collider>;
+};
+// flags are stored as bit planes, EnemyLogicSystem sets Shoots a word at a time
+template <> struct bagel::BitWidth<SpaceInvadersGame::Shoots> : std::integral_constant<int, 1> {};
+template <> struct bagel::BitWidth<SpaceInvadersGame::Input> : std::integral_constant<int, 3> {};
@@ -1,10 +1,30 @@
 // Copyright (C) 2025 Moshe Sulamy
 
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace bagel
 {
@@ -12,30 +32,64 @@ namespace bagel
 	{
 		bool	AggregateUpdates = true;
 		bool	CallbackOnDestroy = true;
+		bool	ComponentBitsets = true;
+		bool	ChangeTracking = false;
 		bool	DynamicResize = true;
+		bool	VirtualMemory = false;
+		bool	HugePages = false;
 		int		IdBagSize = 5;
 		int		InitialEntities = 10000000;
+		int		IdBits = 32;
 		int		InitialPackedSize = 5;
 		int		MaxComponents = 100;
+		int		ArchetypeChunkSize = 16384;
+		int		SparsePageSize = 4096;
+		int		SparseMaxSize = 64;
+		void*	(*Allocate)(std::size_t) = std::malloc;
+		void*	(*Reallocate)(void*, std::size_t) = std::realloc;
+		void	(*Deallocate)(void*) = std::free;
 	};
 
 	template <class T> struct Storage;
 	template <class T> class PackedStorage;
 	template <class T> class SparseStorage;
 	template <class T> class TaggedStorage;
+	template <class T> class HashStorage;
+	template <class T> class BitStorage;
+	template <class T> class ArchetypeStorage;
 
-#if __has_include("bagel_cfg.h")
+// BAGEL_CONFIG may name another config header than bagel_cfg.h
+#if defined(BAGEL_CONFIG) || __has_include("bagel_cfg.h")
 	#define BAGEL_STORAGE(C,T) template <> struct Storage<C> { using type = T<C>; };
-	#include "bagel_cfg.h"
+	#ifdef BAGEL_CONFIG
+		#include BAGEL_CONFIG
+	#else
+		#include "bagel_cfg.h"
+	#endif
 	#undef BAGEL_STORAGE
 #else
 	constexpr Bagel Params{};
 #endif
 
-	using id_type = int;
-	struct ent_type { id_type id; };
+	static_assert(Params.IdBits == 16 || Params.IdBits == 32, "Params.IdBits must be 16 or 32");
+	// -1 is the null id, so 16 bits hold 32767 entities; math stays in int,
+	// only what is stored per entity narrows
+	using id_type = std::conditional_t<Params.IdBits == 16, std::int16_t, std::int32_t>;
+	static_assert(Params.InitialEntities <= std::numeric_limits<id_type>::max(),
+		"Params.InitialEntities does not fit Params.IdBits");
+	// the generation changes each time the id is freed, so an old handle to
+	// a recycled id can be told apart from the new entity; it wraps around
+	using gen_type = std::make_unsigned_t<id_type>;
+	struct ent_type {
+		id_type		id;
+		gen_type	gen = 0;
+	};
 	using size_type = int;
 	using index_type = int;
+	// a dense index never exceeds the entity count, so it shares the id width
+	using slot_type = id_type;
+	using word_type = std::uint64_t;
+	constexpr inline size_type WordBits = 64;
 	using mask_type =
 		std::conditional_t<Params.MaxComponents<=8, std::uint_fast8_t,
 		std::conditional_t<Params.MaxComponents<=16, std::uint_fast16_t,
@@ -50,37 +104,110 @@ namespace bagel
 		void operator=(const NoCopy&) = delete;
 	};
 
+	template <class ...> struct TypeList {};
+
+	template <class T, class ...Ts>
+	constexpr index_type indexOf() {
+		index_type i = 0;
+		((std::is_same_v<T,Ts> ? false : (++i, true)) && ...);
+		return i < index_type(sizeof...(Ts)) ? i : -1;
+	}
+
+	// aggregates have no constructors before C++20, brace-initialize them instead
+	template <class T, class ...Args>
+	T* construct(void* p, Args&&... args) {
+		if constexpr (std::is_constructible_v<T, Args...>)
+			return new (p) T(std::forward<Args>(args)...);
+		else
+			return new (p) T{std::forward<Args>(args)...};
+	}
+	template <class T, class ...Args>
+	T make(Args&&... args) {
+		if constexpr (std::is_constructible_v<T, Args...>)
+			return T(std::forward<Args>(args)...);
+		else
+			return T{std::forward<Args>(args)...};
+	}
+
+	template <class T>
+	struct Span
+	{
+		T*			data = nullptr;
+		size_type	size = 0;
+
+		T* begin() const { return data; }
+		T* end() const { return data + size; }
+		T& operator[](index_type i) const { return data[i]; }
+	};
+
+	// trivially copyable elements are grown with Reallocate, others are move-constructed
 	template <class T, int N>
 	class DynamicBag : NoCopy
 	{
+		static constexpr bool Relocatable = std::is_trivially_copyable_v<T>;
 	public:
-		void push(const T& t) {
-			if (_size == _capacity) {
-				_capacity *= 2;
-				_arr = static_cast<T*>(
-					realloc(_arr, sizeof(T)*_capacity));
-			}
-			_arr[_size] = t;
+		void push(const T& t) { emplace(t); }
+		void push(T&& t) { emplace(std::move(t)); }
+		template <class ...Args>
+		T& emplace(Args&&... args) {
+			if (_size == _capacity)
+				grow(_capacity*2);
+			T* slot = construct<T>(_arr + _size, std::forward<Args>(args)...);
 			++_size;
+			return *slot;
 		}
 		void ensure(size_type s) {
-			if (_capacity < s) {
-				_capacity = std::max(s, _capacity*2);
-				_arr = static_cast<T*>(
-					realloc(_arr, sizeof(T)*_capacity));
-			}
+			if (_capacity < s)
+				grow(std::max(s, _capacity*2));
+		}
+		T pop() {
+			T t = std::move(_arr[--_size]);
+			_arr[_size].~T();
+			return t;
 		}
-		T pop() { return _arr[--_size]; }
 		T& operator[](index_type i) { return _arr[i]; }
 		const T& operator[](index_type i) const { return _arr[i]; }
-		void clear() { _size = 0; }
+		bool assign(const T* data, size_type n) {
+			static_assert(Relocatable, "assign() copies raw bytes");
+			ensure(n);
+			if (n > 0)
+				memcpy(_arr, data, sizeof(T)*n);
+			_size = n;
+			return true;
+		}
+		void clear() {
+			if constexpr (!std::is_trivially_destructible_v<T>)
+				for (index_type i = 0; i < _size; ++i)
+					_arr[i].~T();
+			_size = 0;
+		}
 
 		size_type size() const { return _size; }
 		size_type capacity() const { return _capacity; }
+		std::size_t reservedBytes() const { return sizeof(T)*_capacity; }
+		std::size_t touchedBytes() const { return sizeof(T)*_capacity; }
 
-		~DynamicBag() { free(_arr); }
+		~DynamicBag() {
+			clear();
+			Params.Deallocate(_arr);
+		}
 	private:
-		T*			_arr = static_cast<T*>(malloc(sizeof(T) * N));
+		void grow(size_type capacity) {
+			if constexpr (Relocatable) {
+				_arr = static_cast<T*>(Params.Reallocate(_arr, sizeof(T)*capacity));
+			} else {
+				T* arr = static_cast<T*>(Params.Allocate(sizeof(T)*capacity));
+				for (index_type i = 0; i < _size; ++i) {
+					new (arr + i) T(std::move(_arr[i]));
+					_arr[i].~T();
+				}
+				Params.Deallocate(_arr);
+				_arr = arr;
+			}
+			_capacity = capacity;
+		}
+
+		T*			_arr = static_cast<T*>(Params.Allocate(sizeof(T) * N));
 		size_type	_size = 0;
 		size_type	_capacity = N;
 	};
@@ -89,279 +216,2322 @@ namespace bagel
 	{
 	public:
 		void push(const T& t) { _arr[_size++] = t; }
-		T pop() { return _arr[--_size]; }
+		void push(T&& t) { _arr[_size++] = std::move(t); }
+		template <class ...Args>
+		T& emplace(Args&&... args) { return _arr[_size++] = make<T>(std::forward<Args>(args)...); }
+		T pop() { return std::move(_arr[--_size]); }
 		T& operator[](index_type i) { return _arr[i]; }
 		const T& operator[](index_type i) const { return _arr[i]; }
+		bool assign(const T* data, size_type n) {
+			static_assert(std::is_trivially_copyable_v<T>, "assign() copies raw bytes");
+			if (n > N)
+				return false;
+			if (n > 0)
+				memcpy(_arr, data, sizeof(T)*n);
+			_size = n;
+			return true;
+		}
 		void clear() { _size = 0; }
 
 		size_type size() const { return _size; }
 		static constexpr size_type capacity() { return N; }
+		static constexpr std::size_t reservedBytes() { return sizeof(T)*N; }
+		static constexpr std::size_t touchedBytes() { return sizeof(T)*N; }
 		static void ensure(size_type) {}
 	private:
 		T			_arr[N];
 		size_type	_size = 0;
 	};
-	template <class T, int N>
-	using Bag = std::conditional_t<Params.DynamicResize, DynamicBag<T, N>, StaticBag<T,N>>;
-
-	struct StorageCallbacks
-	{
-		using Destroy = void (*)(ent_type);
-		Destroy destroy = nullptr;
-	};
-	template <class> class StorageRegister;
-
-	template <class T>
-	class SparseStorage final : NoInstance
+#if defined(__linux__)
+	template <class T, int N, bool HugePages = false>
+	class VirtualBag : NoCopy
 	{
+		static_assert(std::is_trivially_copyable_v<T>, "VirtualBag moves pages, requires trivially copyable elements");
 	public:
-		static void add(ent_type e, const T& t) {
-			_bag.ensure(e.id);
-			_bag[e.id] = t;
+		// reserves room for N elements; entity-indexed bags pass Params.InitialEntities
+		VirtualBag() { reserve(pageAlign(sizeof(T) * N)); }
+		void push(const T& t) { emplace(t); }
+		template <class ...Args>
+		T& emplace(Args&&... args) {
+			if (_size == _capacity)
+				commit(_size+1);
+			T* slot = construct<T>(_arr + _size, std::forward<Args>(args)...);
+			++_size;
+			return *slot;
 		}
-		static void del(ent_type) {}
-		static T& get(ent_type e) { return _bag[e.id]; }
-	private:
-		static inline Bag<T,Params.InitialEntities> _bag;
-	};
-	template <class T>
-	class PackedStorage final : NoInstance
-	{
-	public:
-		static void add(ent_type e, const T& t) {
-			_entToComp.ensure(e.id);
-			_entToComp[e.id] = _comps.size();
-			_comps.push(t);
-			_compToEnt.push(e);
+		void ensure(size_type s) {
+			if (_capacity < s)
+				commit(s);
 		}
-		static void del(ent_type e) {
-			index_type ent_comp_idx = _entToComp[e.id];
-			ent_type last_ent = _compToEnt.pop();
+		T pop() { return _arr[--_size]; }
+		T& operator[](index_type i) { return _arr[i]; }
+		const T& operator[](index_type i) const { return _arr[i]; }
+		bool assign(const T* data, size_type n) {
+			ensure(n);
+			if (n > 0)
+				memcpy(_arr, data, sizeof(T)*n);
+			_size = n;
+			return true;
+		}
+		void clear() { _size = 0; }
 
-			_comps[ent_comp_idx] = _comps.pop();
-			_compToEnt[ent_comp_idx] = last_ent;
-			_entToComp[last_ent.id] = ent_comp_idx;
+		size_type size() const { return _size; }
+		size_type capacity() const { return _capacity; }
+		std::size_t reserved() const { return _reserved; }
+		std::size_t reservedBytes() const { return _reserved; }
+		std::size_t touchedBytes() const { return _committed; }
+
+		~VirtualBag() {
+			if (_arr != nullptr)
+				munmap(_arr, _reserved);
 		}
-		static T& get(ent_type e) {
-			return _comps[_entToComp[e.id]];
+	private:
+		static std::size_t pageAlign(std::size_t bytes) {
+			static const std::size_t page = sysconf(_SC_PAGESIZE);
+			return (bytes + page - 1) / page * page;
 		}
-		static int size() { return _comps.size(); }
-		static T& get(index_type idx) {
-			return _comps[idx];
+		static void* map(void* hint, std::size_t bytes) {
+			void* p = mmap(hint, bytes, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (p == MAP_FAILED)
+				return nullptr;
+			if constexpr (HugePages)
+				madvise(p, bytes, MADV_HUGEPAGE);
+			return p;
 		}
-		static ent_type entity(index_type idx) {
-			return _compToEnt[idx];
+		// false if the address space ran out, the old reservation is kept then
+		bool reserve(std::size_t bytes) {
+			if (_arr == nullptr) {
+				_arr = static_cast<T*>(map(nullptr, bytes));
+				_reserved = _arr != nullptr ? bytes : 0;
+				return _arr != nullptr;
+			}
+			char* end = reinterpret_cast<char*>(_arr) + _reserved;
+			void* tail = map(end, bytes - _reserved);
+			if (tail != end) {
+				if (tail != nullptr)
+					munmap(tail, bytes - _reserved);
+				void* p = map(nullptr, bytes);
+				if (p == nullptr)
+					return false;
+				if (_committed > 0 &&
+					mremap(_arr, _committed, _committed, MREMAP_MAYMOVE | MREMAP_FIXED, p) == MAP_FAILED) {
+					munmap(p, bytes);
+					return false;
+				}
+				munmap(_arr, _reserved);
+				_arr = static_cast<T*>(p);
+			}
+			_reserved = bytes;
+			return true;
+		}
+		void commit(size_type s) {
+			const std::size_t bytes = pageAlign(sizeof(T) * std::max(s, _capacity*2));
+			if (bytes > _reserved && !reserve(std::max(bytes, _reserved*2)) && !reserve(bytes))
+				std::abort(); // out of address space
+			if (mprotect(reinterpret_cast<char*>(_arr) + _committed, bytes - _committed,
+					PROT_READ | PROT_WRITE) != 0)
+				std::abort(); // out of memory
+			_committed = bytes;
+			_capacity = bytes / sizeof(T);
 		}
-	private:
-		static inline Bag<T,Params.InitialPackedSize>			_comps;
-		static inline Bag<index_type,Params.InitialEntities>	_entToComp;
-		static inline Bag<ent_type,Params.InitialPackedSize>	_compToEnt;
-
-		static inline StorageCallbacks callbacks{del};
 
-		__attribute__((used))
-		static inline StorageRegister<T> reg{callbacks};
-	};
-	template <class T>
-	class TaggedStorage final : NoInstance
-	{
-	public:
-		static void add(ent_type, const T&) {}
-		static void del(ent_type) {}
-		static T& get(ent_type) = delete;
+		T*			_arr = nullptr;
+		size_type	_size = 0;
+		size_type	_capacity = 0;
+		std::size_t	_committed = 0;
+		std::size_t	_reserved = 0;
 	};
+#else
+	template <class T, int N, bool HugePages = false>
+	using VirtualBag = DynamicBag<T, N>;
+#endif
 
-	template <class T>
-	struct Storage final : NoInstance {
-		using type = SparseStorage<T>;
-	};
+	template <class T, int N, bool HugePages = false>
+	using Bag =
+		std::conditional_t<Params.VirtualMemory && std::is_trivially_copyable_v<T>, VirtualBag<T, N, HugePages>,
+		std::conditional_t<Params.DynamicResize, DynamicBag<T, N>, StaticBag<T,N>>>;
 
-	class SingleMask final
+	template <class T, T Null = T{}, int PageSize = Params.SparsePageSize>
+	class PagedBag : NoCopy
 	{
+		static_assert((PageSize & (PageSize-1)) == 0, "PageSize must be a power of 2");
+		static_assert(std::is_trivially_copyable_v<T>, "PagedBag requires trivially copyable elements");
 	public:
-		using bit_type = mask_type;
-		static constexpr bit_type bit(index_type idx) { return 1<<idx; }
-
-		void set(const bit_type b) { _mask |= b; }
-
-		void clear(const bit_type b) { _mask &= ~b; }
-		void clear() { _mask = 0; }
+		T get(index_type i) const {
+			const index_type p = i / PageSize;
+			return p < _pageCount ? _pages[p][i % PageSize] : Null;
+		}
+		T& operator[](index_type i) {
+			const index_type p = i / PageSize;
+			if (p >= _pageCount)
+				grow(p+1);
+			if (_pages[p] == nullPage())
+				commit(p);
+			return _pages[p][i % PageSize];
+		}
+		void clear() {
+			for (index_type p = 0; p < _pageCount; ++p)
+				if (_pages[p] != nullPage())
+					Params.Deallocate(_pages[p]);
+			Params.Deallocate(_pages);
+			_pages = nullptr;
+			_pageCount = 0;
+			_committed = 0;
+		}
 
-		bool test(const bit_type b) const { return _mask & b; }
-		bool test(const SingleMask m) const { return (_mask & m._mask) == m._mask; }
+		size_type pageCount() const { return _pageCount; }
+		size_type capacity() const { return _committed*PageSize; }
+		size_type committedPages() const { return _committed; }
+		static constexpr size_type pageSize() { return PageSize; }
+		std::size_t reservedBytes() const { return touchedBytes(); }
+		std::size_t touchedBytes() const { return sizeof(T*)*_pageCount + sizeof(T)*PageSize*_committed; }
 
-		index_type ctz() const { return _mask ? __builtin_ctz(_mask) : -1; }
+		~PagedBag() { clear(); }
 	private:
-		mask_type	_mask{0};
+		static T* nullPage() {
+			static T* const page = [] {
+				static T arr[PageSize];
+				std::fill(arr, arr+PageSize, Null);
+				return arr;
+			}();
+			return page;
+		}
+		void grow(size_type count) {
+			count = std::max(count, _pageCount*2);
+			_pages = static_cast<T**>(Params.Reallocate(_pages, sizeof(T*)*count));
+			std::fill(_pages+_pageCount, _pages+count, nullPage());
+			_pageCount = count;
+		}
+		void commit(index_type p) {
+			_pages[p] = static_cast<T*>(Params.Allocate(sizeof(T)*PageSize));
+			std::fill(_pages[p], _pages[p]+PageSize, Null);
+			++_committed;
+		}
+
+		T**			_pages = nullptr;
+		size_type	_pageCount = 0;
+		size_type	_committed = 0;
 	};
-	class MultiMask final
+
+	// one independent world. World and the storages act on the registry current
+	// on the calling thread: the global one, unless a Scope selects another
+	class Registry : NoCopy
 	{
 	public:
-		using bit_type = struct {
-			const index_type	index;
-			const mask_type		mask;
-		};
-		static constexpr bit_type bit(index_type idx) {
-			return {idx/BitsetWidth, static_cast<mask_type>(1<<(idx%BitsetWidth))};
-		}
+		static constexpr index_type WorldSlot = 0, ArchetypeSlot = 1, StorageSlot = 2;
 
-		void set(const bit_type& b) { _masks[b.index] |= b.mask; }
+		constexpr Registry() = default;
+		~Registry() {
+			for (index_type i = Slots-1; i >= 0; --i) {
+				void* p = _slots[i].state.load(std::memory_order_relaxed);
+				if (p != nullptr)
+					_slots[i].destroy(p);
+			}
+		}
+		static Registry& current();
+		static Registry& global();
 
-		void clear(const bit_type& b) { _masks[b.index] &= ~b.mask; }
-		void clear() { memset(_masks, 0, sizeof(_masks)); }
+		class Scope : NoCopy
+		{
+		public:
+			explicit Scope(Registry& r) : _prev(_current) { _current = &r == &global() ? nullptr : &r; }
+			~Scope() { _current = _prev; }
+		private:
+			Registry* _prev;
+		};
 
-		bool test(const bit_type& b) const { return _masks[b.index] & b.mask; }
-		bool test(const MultiMask& m) const {
-			for (index_type i = 0; i < Size; ++i)
-				if ((_masks[i] & m._masks[i]) != m._masks[i])
-					return false;
-			return true;
+		// S::State of the current registry; the global registry keeps its states in
+		// S::_global, so outside a Scope this is a constant address
+		template <class S>
+		__attribute__((always_inline))
+		static typename S::State& resolve(index_type slot) {
+			Registry* r = _current;
+			if (r == nullptr)
+				return S::_global;
+			void* p = r->find(slot);
+			if (__builtin_expect(p == nullptr, 0))
+				p = r->create<S>(slot);
+			return *static_cast<typename S::State*>(p);
 		}
-
-		index_type ctz() const {
-			for (index_type i = 0; i < Size; ++i) {
-				if (_masks[i]) {
-					int c = __builtin_ctz(_masks[i]);
-					return c + i*BitsetWidth;
-				}
+	private:
+		// the slot's state, nullptr until create(); pure because it only reads and a
+		// set slot never changes, so repeated finds in a loop may be merged. create()
+		// writes memory, so a find after it is evaluated again
+		__attribute__((noinline, pure))
+		void* find(index_type slot) const {
+			return _slots[slot].state.load(std::memory_order_acquire);
+		}
+		template <class S>
+		__attribute__((noinline))
+		void* create(index_type slot) {
+			std::lock_guard<std::mutex> lock(_lock);
+			Slot& s = _slots[slot];
+			void* p = s.state.load(std::memory_order_relaxed);
+			if (p == nullptr) {
+				p = new typename S::State;
+				s.destroy = [](void* q) { delete static_cast<typename S::State*>(q); };
+				s.state.store(p, std::memory_order_release);
 			}
-			return -1;
+			return p;
 		}
-	private:
-		static constexpr size_type	Size = (Params.MaxComponents-1)/BitsetWidth + 1;
-		mask_type					_masks[Size] ={};
+
+		struct Slot {
+			std::atomic<void*>	state{nullptr};
+			void				(*destroy)(void*) = nullptr;
+		};
+		static constexpr size_type Slots = StorageSlot + Params.MaxComponents;
+		Slot		_slots[Slots];
+		std::mutex	_lock;
+
+		// nullptr while the global registry is current
+		static inline thread_local Registry* _current = nullptr;
 	};
-	using Mask = std::conditional_t<Params.MaxComponents<=BitsetWidth, SingleMask, MultiMask>;
+	// constant-initialized, so usable from any static initializer
+	inline Registry globalRegistry;
+	inline Registry& Registry::global() { return globalRegistry; }
+	inline Registry& Registry::current() { return _current != nullptr ? *_current : globalRegistry; }
+	template <class T> index_type componentIndex();
 
-	static inline index_type compCounter = -1;
-	template <class>
-	struct Component final : NoInstance
+	// snapshot streams: storages append their payload behind a section header
+	class SnapshotWriter : NoCopy
 	{
-		static inline const index_type		Index = ++compCounter;
-		static inline const Mask::bit_type	Bit = Mask::bit(Index);
+	public:
+		explicit SnapshotWriter(std::FILE* f) : _f(f) {}
+		void write(const void* p, std::size_t bytes) {
+			if (bytes > 0 && std::fwrite(p, 1, bytes, _f) != bytes)
+				_ok = false;
+		}
+		template <class T>
+		void write(const T& t) { write(&t, sizeof(T)); }
+		bool ok() const { return _ok; }
+	private:
+		std::FILE*	_f;
+		bool		_ok = true;
 	};
-
-	struct AddedMask {
-		Mask prev;
-		Mask next;
-		ent_type e;
+	class SnapshotReader : NoCopy
+	{
+	public:
+		SnapshotReader(const unsigned char* data, std::size_t bytes) : _pos(data), _end(data + bytes) {}
+		// nullptr once the data runs out
+		const void* read(std::size_t bytes) {
+			if (bytes > std::size_t(_end - _pos))
+				return nullptr;
+			const void* p = _pos;
+			_pos += bytes;
+			return p;
+		}
+		template <class T>
+		bool read(T& t) {
+			const void* p = read(sizeof(T));
+			if (p != nullptr)
+				memcpy(&t, p, sizeof(T));
+			return p != nullptr;
+		}
+	private:
+		const unsigned char*	_pos;
+		const unsigned char*	_end;
 	};
 
-	class World final : NoInstance
+	// the whole file, mapped read-only where mmap is available
+	class MappedFile : NoCopy
 	{
 	public:
-		static ent_type createEntity() {
-			if (_ids.size() > 0)
-				return _ids.pop();
-			_masks.push(Mask{});
-			return {++_maxId.id};
-		}
-		static void destroyEntity(ent_type ent) {
-			if constexpr (Params.CallbackOnDestroy) {
-				Mask m = _masks[ent.id];
-				int ctz = m.ctz(); // count-trailing-zeros
-				while (ctz >= 0) {
-					if (_callbacks[ctz].destroy != nullptr)
-						_callbacks->destroy(ent);
-					m.clear(Mask::bit(ctz));
-					ctz = m.ctz();
+		explicit MappedFile(const char* path) {
+#if defined(__linux__)
+			const int fd = open(path, O_RDONLY);
+			if (fd < 0)
+				return;
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size > 0) {
+				void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					madvise(p, st.st_size, MADV_SEQUENTIAL);
+					_data = static_cast<const unsigned char*>(p);
+					_size = st.st_size;
+				}
+			}
+			close(fd);
+#else
+			std::FILE* f = std::fopen(path, "rb");
+			if (f == nullptr)
+				return;
+			if (std::fseek(f, 0, SEEK_END) == 0) {
+				const long size = std::ftell(f);
+				void* p = size > 0 ? Params.Allocate(size) : nullptr;
+				std::rewind(f);
+				if (p != nullptr && std::fread(p, 1, size, f) == std::size_t(size)) {
+					_data = static_cast<const unsigned char*>(p);
+					_size = size;
+				} else {
+					Params.Deallocate(p);
 				}
 			}
-			_masks[ent.id].clear();
-			_ids.push(ent);
+			std::fclose(f);
+#endif
 		}
-		static const Mask& mask(ent_type e) {
-			return _masks[e.id];
+		~MappedFile() {
+			if (_data == nullptr)
+				return;
+#if defined(__linux__)
+			munmap(const_cast<unsigned char*>(_data), _size);
+#else
+			Params.Deallocate(const_cast<unsigned char*>(_data));
+#endif
 		}
-		static ent_type maxId() { return _maxId; }
+		const unsigned char* data() const { return _data; }
+		std::size_t size() const { return _size; }
+	private:
+		const unsigned char*	_data = nullptr;
+		std::size_t				_size = 0;
+	};
 
-		template <class T>
-		static T& getComponent(ent_type e) {
-			return Storage<T>::type::get(e);
+	// reserved counts address space, touched the memory actually committed;
+	// peak is the most elements held at once (for World tables, bags never
+	// shrink, so it is their capacity)
+	struct MemoryStats {
+		const char*	name = "";
+		const char*	kind = "";
+		size_type	elemSize = 0;
+		size_type	capacity = 0;
+		size_type	live = 0;
+		size_type	peak = 0;
+		std::size_t	reserved = 0;
+		std::size_t	touched = 0;
+	};
+	struct MemoryReport {
+		StaticBag<MemoryStats,Params.MaxComponents>	storages;
+		StaticBag<MemoryStats,16>					world;
+
+		std::size_t reserved() const { return sum(&MemoryStats::reserved); }
+		std::size_t touched() const { return sum(&MemoryStats::touched); }
+
+		void writeJson(std::FILE* f) const {
+			std::fprintf(f, "{\n  \"reserved\": %zu,\n  \"touched\": %zu,\n", reserved(), touched());
+			writeJson(f, "storages", storages);
+			std::fprintf(f, ",\n");
+			writeJson(f, "world", world);
+			std::fprintf(f, "\n}\n");
+		}
+	private:
+		std::size_t sum(std::size_t MemoryStats::* field) const {
+			std::size_t total = 0;
+			for (index_type i = 0; i < storages.size(); ++i)
+				total += storages[i].*field;
+			for (index_type i = 0; i < world.size(); ++i)
+				total += world[i].*field;
+			return total;
+		}
+		template <class B>
+		static void writeJson(std::FILE* f, const char* key, const B& list) {
+			std::fprintf(f, "  \"%s\": [", key);
+			for (index_type i = 0; i < list.size(); ++i) {
+				const MemoryStats& m = list[i];
+				std::fprintf(f, "%s\n    {\"name\": \"%s\", \"kind\": \"%s\", \"elemSize\": %d, "
+					"\"capacity\": %d, \"live\": %d, \"peak\": %d, \"reserved\": %zu, \"touched\": %zu}",
+					i > 0 ? "," : "", m.name, m.kind, m.elemSize, m.capacity, m.live, m.peak, m.reserved, m.touched);
+			}
+			std::fprintf(f, "\n  ]");
 		}
+	};
 
-		template <class T>
-		static void addComponent(ent_type e, const T& t) {
-			Mask prev = _masks[e.id];
+	struct StorageCallbacks
+	{
+		using Destroy = void (*)(ent_type);
+		using DestroyAll = void (*)(Span<const ent_type>);
+		Destroy destroy = nullptr;
+		DestroyAll destroyAll = nullptr;
+		// fills kind, capacity, peak and bytes; World fills the rest
+		void (*memory)(MemoryStats&) = nullptr;
+		// snapshots; storages without save() cannot be persisted. load() with
+		// apply false only checks that the payload is complete
+		void (*save)(SnapshotWriter&, id_type maxId) = nullptr;
+		bool (*load)(SnapshotReader&, bool apply) = nullptr;
+		void (*clear)() = nullptr;
+		void (*loaded)() = nullptr;
+		std::uint64_t key = 0;
+		size_type size = 0;
+		const char* name = "";
+	};
 
-			_masks[e.id].set(Component<T>::Bit);
-			Storage<T>::type::add(e,t);
+	// stable across runs of one build, unlike indices handed out at first use
+	template <class T>
+	std::uint64_t typeKey() {
+		std::uint64_t h = 14695981039346656037ull;
+		for (const char* c = __PRETTY_FUNCTION__; *c != 0; ++c)
+			h = (h ^ std::uint64_t(*c)) * 1099511628211ull;
+		return h;
+	}
+	// T as the compiler spells it, for reports
+	template <class T>
+	const char* typeName() {
+		struct Name { char str[128] = {}; };
+		const char* pretty = __PRETTY_FUNCTION__;
+		static const Name name = [pretty] {
+			Name n;
+			const char* b = std::strstr(pretty, "T = ");
+			b = b != nullptr ? b+4 : pretty;
+			for (std::size_t i = 0; i+1 < sizeof(n.str) && b[i] != 0 && b[i] != ';' && b[i] != ']'; ++i)
+				n.str[i] = b[i];
+			return n;
+		}();
+		return name.str;
+	}
+	template <class> class StorageRegister;
 
-			if constexpr (Params.AggregateUpdates) {
-				Mask next = _masks[e.id];
-				_added.push({prev,next,e});
-			}
+	template <class T>
+	class SparseStorage final : NoInstance
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "SparseStorage requires trivially copyable components");
+	public:
+		template <class ...Args>
+		static void emplace(ent_type e, Args&&... args) {
+			s()._bag.ensure(e.id+1);
+			construct<T>(&s()._bag[e.id], std::forward<Args>(args)...);
+			s()._peak = std::max(s()._peak, e.id+1);
 		}
-		template <class T, class...Ts>
-		static void addComponents(ent_type e, const T& t, const Ts&... ts) {
-			addComponent(e, t);
-			if constexpr (sizeof...(Ts)>0)
-				addComponents(e, ts...);
+		static void add(ent_type e, const T& t) { emplace(e, t); }
+		static void del(ent_type) {}
+		static T& get(ent_type e) { return s()._bag[e.id]; }
+		static void reserve(id_type maxId, size_type) { s()._bag.ensure(maxId+1); }
+	private:
+		// the slots up to maxId, live or not
+		static void save(SnapshotWriter& w, id_type maxId) {
+			const std::uint32_t n = std::min(s()._bag.capacity(), maxId+1);
+			w.write(n);
+			if (n > 0)
+				w.write(&s()._bag[0], sizeof(T)*n);
 		}
-
-		template <class T>
-		static void delComponent(ent_type e) {
-			_masks[e.id].clear(Component<T>::Bit);
-			Storage<T>::type::del(e);
+		static bool load(SnapshotReader& r, bool apply) {
+			std::uint32_t n;
+			if (!r.read(n))
+				return false;
+			const void* p = r.read(sizeof(T)*n);
+			if (p == nullptr || !apply)
+				return p != nullptr;
+			s()._bag.ensure(n);
+			if (s()._bag.capacity() < size_type(n))
+				return false;
+			if (n > 0)
+				memcpy(&s()._bag[0], p, sizeof(T)*n);
+			s()._peak = std::max(s()._peak, size_type(n));
+			return true;
 		}
-		template <class T, class ...Ts>
-		static void delComponents(ent_type e) {
-			delComponent<T>(e);
-			if constexpr (sizeof...(Ts)>0)
-				delComponents<Ts...>(e);
+		// one slot per id, so the peak is the highest id stored plus one
+		static void memory(MemoryStats& m) {
+			m.kind = "sparse";
+			m.capacity = s()._bag.capacity();
+			m.peak = s()._peak;
+			m.reserved = s()._bag.reservedBytes();
+			m.touched = s()._bag.touchedBytes();
 		}
 
-		template <class T>
-		static void registerStorage(StorageCallbacks& cb) {
-			_callbacks[Component<T>::Index] = cb;
+		friend class Registry;
+		struct State {
+			Bag<T,Params.InitialEntities,Params.HugePages> _bag;
+			size_type _peak = 0;
+		};
+		static inline State _global;
+		__attribute__((always_inline))
+		static State& s() {
+			return Registry::resolve<SparseStorage>(Registry::StorageSlot + componentIndex<T>());
 		}
 
-		static size_type sizeAdded() { return _added.size(); }
-		static const AddedMask& getAdded(int i) { return _added[i]; }
-
-		static void step() { _added.clear(); }
-	private:
-		static inline StorageCallbacks _callbacks[Params.MaxComponents] = {nullptr};
-		static inline Bag<AddedMask,Params.IdBagSize>		_added;
+		static inline StorageCallbacks callbacks{nullptr, nullptr, memory, save, load};
 
-		static inline ent_type								_maxId{-1};
-		static inline Bag<Mask,		Params.InitialEntities> _masks;
-		static inline Bag<ent_type,	Params.IdBagSize>		_ids;
+		__attribute__((used))
+		static inline StorageRegister<T> reg{callbacks};
 	};
+	enum class SortMode { Full, Incremental };
+
+	// interleaves the bits of x and y, so nearby cells get nearby codes
+	constexpr std::uint64_t morton2D(std::uint32_t x, std::uint32_t y) {
+		auto spread = [](std::uint64_t v) {
+			v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+			v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+			v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+			v = (v | (v << 2)) & 0x3333333333333333ull;
+			v = (v | (v << 1)) & 0x5555555555555555ull;
+			return v;
+		};
+		return spread(x) | (spread(y) << 1);
+	}
 
 	template <class T>
-	class StorageRegister
+	class PackedStorage final : NoInstance
 	{
 	public:
-		StorageRegister(StorageCallbacks& cb) {
-			World::registerStorage<T>(cb);
+		template <class ...Args>
+		static void emplace(ent_type e, Args&&... args) {
+			slot_type& idx = s()._entToComp[e.id];
+			if (idx >= 0) {
+				s()._comps[idx] = make<T>(std::forward<Args>(args)...);
+				return;
+			}
+			idx = s()._comps.size();
+			s()._comps.emplace(std::forward<Args>(args)...);
+			s()._compToEnt.push(e);
+			s()._peak = std::max(s()._peak, idx+1);
+			if (s()._owner.added != nullptr)
+				s()._owner.added(e);
 		}
-	};
-
-	class Entity
-	{
-	public:
-		Entity(ent_type e) : _ent(e) {}
-		ent_type entity() const { return _ent; }
+		static void add(ent_type e, const T& t) { emplace(e, t); }
+		static void add(ent_type e, T&& t) { emplace(e, std::move(t)); }
+		static void del(ent_type e) {
+			if (s()._entToComp.get(e.id) < 0)
+				return;
+			if (s()._owner.removed != nullptr)
+				s()._owner.removed(e);
+			index_type ent_comp_idx = s()._entToComp.get(e.id);
+			s()._entToComp[e.id] = -1;
+			ent_type last_ent = s()._compToEnt.pop();
+			T last_comp = s()._comps.pop();
+			if (last_ent.id == e.id)
+				return;
 
-		static Entity create() { return World::createEntity(); }
-		void destroy() const { World::destroyEntity(_ent); }
+			s()._comps[ent_comp_idx] = std::move(last_comp);
+			s()._compToEnt[ent_comp_idx] = last_ent;
+			s()._entToComp[last_ent.id] = ent_comp_idx;
+		}
+		// a large share is compacted in one forward pass; otherwise victims are
+		// swap-removed highest index first, so the tail never holds a pending one
+		static void delAll(Span<const ent_type> ents) {
+			if (s()._owner.removed == nullptr && ents.size * 8 >= size_type(s()._comps.size())) {
+				compact(ents);
+				return;
+			}
+			DynamicBag<index_type,64> victims;
+			for (ent_type e : ents)
+				if (has(e))
+					victims.push(index(e));
+			if (victims.size() == 0)
+				return;
+			std::sort(&victims[0], &victims[0] + victims.size(), [](index_type a, index_type b) { return a > b; });
+			for (index_type i = 0; i < victims.size(); ++i)
+				del(s()._compToEnt[victims[i]]);
+		}
+		static T& get(ent_type e) {
+			State& st = s();
+			return st._comps[st._entToComp.get(e.id)];
+		}
+		static void reserve(id_type, size_type n) {
+			s()._comps.ensure(s()._comps.size() + n);
+			s()._compToEnt.ensure(s()._compToEnt.size() + n);
+		}
+		static bool has(ent_type e) { return s()._entToComp.get(e.id) >= 0; }
+		static index_type index(ent_type e) { return s()._entToComp.get(e.id); }
+		static int size() { return s()._comps.size(); }
+		static void swap(index_type i, index_type j) {
+			if (i == j)
+				return;
+			std::swap(s()._comps[i], s()._comps[j]);
+			std::swap(s()._compToEnt[i], s()._compToEnt[j]);
+			s()._entToComp[s()._compToEnt[i].id] = i;
+			s()._entToComp[s()._compToEnt[j].id] = j;
+		}
 
-		const Mask& mask() const { return World::mask(_ent); }
+		// Full sorts by key; Incremental is an insertion sort, cheap when the
+		// order barely changed since the last sort. Group members stay in front.
+		template <class Key>
+		static void sort(Key key, SortMode mode = SortMode::Full) {
+			const index_type owned = s()._owner.size != nullptr ? s()._owner.size() : 0;
+			sortRange(0, owned, key, mode, true);
+			sortRange(owned, s()._comps.size(), key, mode, false);
+		}
 
-		template <class T> T& get() const { return World::getComponent<T>(_ent); }
-		template <class T> void add(const T& t) const {
-			return World::addComponent<T>(_ent, t);
+		// an owning group keeps its members at the front; one owner per storage
+		struct Owner {
+			void (*added)(ent_type) = nullptr;
+			void (*removed)(ent_type) = nullptr;
+			size_type (*size)() = nullptr;
+			void (*swap)(index_type, index_type) = nullptr;
+			void (*rebuild)() = nullptr;
+		};
+		static bool own(const Owner& owner) {
+			if (s()._owner.added != nullptr && s()._owner.added != owner.added)
+				return false;
+			s()._owner = owner;
+			return true;
 		}
-		template <class T> void del() const {
-			return World::delComponent<T>(_ent);
+		static T& get(index_type idx) {
+			return s()._comps[idx];
 		}
+		static ent_type entity(index_type idx) {
+			return s()._compToEnt[idx];
+		}
+		static Span<T> components() { return {&s()._comps[0], s()._comps.size()}; }
+		static Span<const ent_type> entities() { return {&s()._compToEnt[0], s()._compToEnt.size()}; }
+	private:
+		friend class Registry;
+		template <class, class, class> friend class View;
+		template <class, class...> friend class Group;
 
-		template <class T, class ...Ts> void addAll(const T& t, const Ts&... ts) const {
-			World::addComponents(_ent, t, ts...);
+		static void compact(Span<const ent_type> ents) {
+			for (ent_type e : ents)
+				if (has(e))
+					s()._entToComp[e.id] = -1;
+			const index_type n = s()._comps.size();
+			index_type w = 0;
+			for (index_type i = 0; i < n; ++i) {
+				const ent_type e = s()._compToEnt[i];
+				if (s()._entToComp.get(e.id) < 0)
+					continue;
+				if (w != i) {
+					s()._comps[w] = std::move(s()._comps[i]);
+					s()._compToEnt[w] = e;
+					s()._entToComp[e.id] = w;
+				}
+				++w;
+			}
+			while (s()._comps.size() > size_type(w)) {
+				s()._comps.pop();
+				s()._compToEnt.pop();
+			}
 		}
-		template <class T, class ...Ts> void delAll() const {
-			World::delComponents<T,Ts...>(_ent);
+
+		template <class Key>
+		static void sortRange(index_type first, index_type last, Key& key, SortMode mode, bool owned) {
+			auto exchange = [owned](index_type i, index_type j) {
+				if (owned)
+					s()._owner.swap(i, j);
+				else
+					swap(i, j);
+			};
+			if (mode == SortMode::Incremental) {
+				for (index_type i = first+1; i < last; ++i)
+					for (index_type j = i; j > first && key(s()._comps[j]) < key(s()._comps[j-1]); --j)
+						exchange(j-1, j);
+				return;
+			}
+			const size_type n = last - first;
+			if (n < 2)
+				return;
+			using K = std::decay_t<decltype(key(std::declval<const T&>()))>;
+			struct Entry { K key; index_type index; };
+			DynamicBag<Entry,64> order;
+			DynamicBag<index_type,64> at, where;
+			for (index_type i = 0; i < n; ++i) {
+				order.push({key(s()._comps[first+i]), i});
+				at.push(i);
+				where.push(i);
+			}
+			std::stable_sort(&order[0], &order[0] + n, [](const Entry& a, const Entry& b) {
+				return a.key < b.key;
+			});
+			// swap each element into place, tracking where the displaced ones went
+			for (index_type k = 0; k < n; ++k) {
+				const index_type o = order[k].index, src = where[o];
+				if (src == k)
+					continue;
+				exchange(first+k, first+src);
+				const index_type displaced = at[k];
+				at[src] = displaced;
+				where[displaced] = src;
+				at[k] = o;
+				where[o] = k;
+			}
+		}
+
+		struct State {
+			Bag<T,Params.InitialPackedSize>			_comps;
+			PagedBag<slot_type,-1>					_entToComp;
+			Bag<ent_type,Params.InitialPackedSize>	_compToEnt;
+			Owner									_owner;
+			size_type								_owned = 0;
+			size_type								_peak = 0;
+		};
+		static inline State _global;
+		__attribute__((always_inline))
+		static State& s() {
+			return Registry::resolve<PackedStorage>(Registry::StorageSlot + componentIndex<T>());
+		}
+
+		static void save(SnapshotWriter& w, id_type) {
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				const std::uint32_t n = s()._comps.size();
+				w.write(n);
+				if (n > 0) {
+					w.write(&s()._comps[0], sizeof(T)*n);
+					w.write(&s()._compToEnt[0], sizeof(ent_type)*n);
+				}
+			}
+		}
+		static bool load(SnapshotReader& r, bool apply) {
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				std::uint32_t n;
+				if (!r.read(n))
+					return false;
+				const T* comps = static_cast<const T*>(r.read(sizeof(T)*n));
+				const ent_type* ents = static_cast<const ent_type*>(r.read(sizeof(ent_type)*n));
+				if (comps == nullptr || ents == nullptr || !apply)
+					return comps != nullptr && ents != nullptr;
+				if (!s()._comps.assign(comps, n) || !s()._compToEnt.assign(ents, n))
+					return false;
+				for (index_type i = 0; i < index_type(n); ++i)
+					s()._entToComp[s()._compToEnt[i].id] = i;
+				s()._peak = std::max(s()._peak, size_type(n));
+			}
+			return true;
+		}
+		static void memory(MemoryStats& m) {
+			m.kind = "packed";
+			m.capacity = s()._comps.capacity();
+			m.peak = s()._peak;
+			m.reserved = s()._comps.reservedBytes() + s()._compToEnt.reservedBytes() + s()._entToComp.reservedBytes();
+			m.touched = s()._comps.touchedBytes() + s()._compToEnt.touchedBytes() + s()._entToComp.touchedBytes();
+		}
+		static void clear() {
+			s()._comps.clear();
+			s()._compToEnt.clear();
+			s()._entToComp.clear();
+		}
+		// group order was saved along with the arrays; only the owner's count is stale
+		static void loaded() {
+			if (s()._owner.rebuild != nullptr)
+				s()._owner.rebuild();
+		}
+
+		static inline StorageCallbacks callbacks{del, delAll, memory,
+			std::is_trivially_copyable_v<T> ? save : nullptr, load, clear, loaded};
+
+		__attribute__((used))
+		static inline StorageRegister<T> reg{callbacks};
+	};
+	// robin-hood open addressing keyed by id, values inline: memory follows the
+	// population, a lookup is one probe run. References are invalidated by the
+	// next add or remove of T, as in PackedStorage
+	template <class T>
+	class HashStorage final : NoInstance
+	{
+	public:
+		template <class ...Args>
+		static void emplace(ent_type e, Args&&... args) {
+			const index_type i = find(e.id);
+			if (i >= 0)
+				s()._slots[i].value = make<T>(std::forward<Args>(args)...);
+			else
+				insert(e.id, make<T>(std::forward<Args>(args)...));
+		}
+		static void add(ent_type e, const T& t) { emplace(e, t); }
+		static void add(ent_type e, T&& t) { emplace(e, std::move(t)); }
+		// backward shift, so no tombstones lengthen later probes
+		static void del(ent_type e) {
+			index_type i = find(e.id);
+			if (i < 0)
+				return;
+			State& st = s();
+			const index_type mask = st._capacity - 1;
+			st._slots[i].value.~T();
+			for (index_type j = (i+1) & mask; st._slots[j].key >= 0 && st._slots[j].dist > 0; i = j, j = (j+1) & mask) {
+				Slot& from = st._slots[j];
+				st._slots[i].key = from.key;
+				st._slots[i].dist = from.dist - 1;
+				construct<T>(&st._slots[i].value, std::move(from.value));
+				from.value.~T();
+			}
+			st._slots[i].key = -1;
+			--st._size;
+		}
+		static T& get(ent_type e) { return s()._slots[find(e.id)].value; }
+		static bool has(ent_type e) { return find(e.id) >= 0; }
+		static void reserve(id_type, size_type n) {
+			State& st = s();
+			size_type capacity = std::max(st._capacity, 16);
+			while ((st._size + n) * 8 > capacity * 7)
+				capacity *= 2;
+			if (capacity != st._capacity)
+				rehash(capacity);
+		}
+		static size_type size() { return s()._size; }
+	private:
+		struct Slot {
+			id_type	key = -1;
+			index_type	dist = 0;
+			union { T value; };
+
+			Slot() {}
+			~Slot() {}
+		};
+		struct State;
+
+		static index_type home(id_type id, index_type mask) {
+			return index_type((std::uint64_t(std::uint32_t(id)) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+		}
+		static index_type find(id_type id) {
+			const State& st = s();
+			if (st._size == 0)
+				return -1;
+			const index_type mask = st._capacity - 1;
+			for (index_type i = home(id, mask), d = 0; ; i = (i+1) & mask, ++d) {
+				const Slot& slot = st._slots[i];
+				if (slot.key == id)
+					return i;
+				if (slot.key < 0 || slot.dist < d)
+					return -1;
+			}
+		}
+		static void insert(id_type id, T&& t) {
+			State& st = s();
+			if ((st._size + 1) * 8 > st._capacity * 7)
+				rehash(std::max(16, st._capacity * 2));
+			place(st, id, std::move(t));
+			st._peak = std::max(st._peak, ++st._size);
+		}
+		// the richer entry keeps walking, the poorer one takes the slot
+		static void place(State& st, id_type id, T&& t) {
+			const index_type mask = st._capacity - 1;
+			index_type dist = 0;
+			for (index_type i = home(id, mask); ; i = (i+1) & mask, ++dist) {
+				Slot& slot = st._slots[i];
+				if (slot.key < 0) {
+					slot.key = id;
+					slot.dist = dist;
+					construct<T>(&slot.value, std::move(t));
+					return;
+				}
+				if (slot.dist < dist) {
+					std::swap(id, slot.key);
+					std::swap(dist, slot.dist);
+					std::swap(t, slot.value);
+				}
+			}
+		}
+		static void rehash(size_type capacity) {
+			State& st = s();
+			Slot* old = st._slots;
+			const size_type oldCapacity = st._capacity;
+			st._slots = static_cast<Slot*>(Params.Allocate(sizeof(Slot)*capacity));
+			for (index_type i = 0; i < capacity; ++i)
+				new (st._slots + i) Slot;
+			st._capacity = capacity;
+			for (index_type i = 0; i < oldCapacity; ++i) {
+				if (old[i].key < 0)
+					continue;
+				place(st, old[i].key, std::move(old[i].value));
+				old[i].value.~T();
+			}
+			Params.Deallocate(old);
+		}
+
+		static void save(SnapshotWriter& w, id_type) {
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				w.write(std::uint32_t(s()._size));
+				for (index_type i = 0; i < s()._capacity; ++i) {
+					if (s()._slots[i].key < 0)
+						continue;
+					w.write(s()._slots[i].key);
+					w.write(s()._slots[i].value);
+				}
+			}
+		}
+		static bool load(SnapshotReader& r, bool apply) {
+			if constexpr (std::is_trivially_copyable_v<T>) {
+				std::uint32_t n;
+				if (!r.read(n))
+					return false;
+				if (apply)
+					reserve(0, n);
+				for (std::uint32_t i = 0; i < n; ++i) {
+					ent_type e;
+					T t;
+					if (!r.read(e.id) || !r.read(t))
+						return false;
+					if (apply)
+						add(e, t);
+				}
+			}
+			return true;
+		}
+		static void clear() { s().clear(); }
+		static void memory(MemoryStats& m) {
+			m.kind = "hash";
+			m.capacity = s()._capacity;
+			m.peak = s()._peak;
+			m.reserved = m.touched = sizeof(Slot) * s()._capacity;
+		}
+
+		friend class Registry;
+		struct State : NoCopy {
+			Slot*		_slots = nullptr;
+			size_type	_capacity = 0;
+			size_type	_size = 0;
+			size_type	_peak = 0;
+
+			void clear() {
+				for (index_type i = 0; i < _capacity; ++i)
+					if (_slots[i].key >= 0)
+						_slots[i].value.~T();
+				Params.Deallocate(_slots);
+				_slots = nullptr;
+				_capacity = _size = 0;
+			}
+			~State() { clear(); }
+		};
+		static inline State _global;
+		__attribute__((always_inline))
+		static State& s() {
+			return Registry::resolve<HashStorage>(Registry::StorageSlot + componentIndex<T>());
+		}
+
+		static inline StorageCallbacks callbacks{del, nullptr, memory,
+			std::is_trivially_copyable_v<T> ? save : nullptr, load, clear};
+
+		__attribute__((used))
+		static inline StorageRegister<T> reg{callbacks};
+	};
+
+	// the mask bit is the whole component; every entity shares one instance
+	template <class T>
+	class TaggedStorage final : NoInstance
+	{
+		static_assert(std::is_empty_v<T>, "TaggedStorage stores no data, requires an empty component");
+	public:
+		template <class ...Args>
+		static void emplace(ent_type, Args&&...) {}
+		static void add(ent_type, const T&) {}
+		static void del(ent_type) {}
+		static T& get(ent_type) { return _tag; }
+		static void reserve(id_type, size_type) {}
+	private:
+		static void memory(MemoryStats& m) {
+			m.kind = "tagged";
+			m.elemSize = 0;
+		}
+		// masks and bitsets already hold everything
+		static void save(SnapshotWriter&, id_type) {}
+		static bool load(SnapshotReader&, bool) { return true; }
+
+		static inline T _tag{};
+		static inline StorageCallbacks callbacks{nullptr, nullptr, memory, save, load};
+
+		__attribute__((used))
+		static inline StorageRegister<T> reg{callbacks};
+	};
+
+	// one flag per byte of T, so structs of bools; specialize to store T as bit planes
+	template <class T>
+	struct BitWidth : std::integral_constant<int, 0> {};
+
+	// one bit plane per flag, indexed by id. get() returns a proxy, so read by
+	// value and write whole components. Planes hold bits of members only: bulk
+	// writers must keep the component's World::bitWord as their mask
+	template <class T>
+	class BitStorage final : NoInstance
+	{
+		static constexpr int Width = BitWidth<T>::value;
+		static_assert(std::is_trivially_copyable_v<T> && sizeof(T) == Width,
+			"BitStorage requires a component made of Width bools");
+	public:
+		class Ref
+		{
+		public:
+			explicit Ref(ent_type e) : _ent(e) {}
+			operator T() const { return value(_ent); }
+			const Ref& operator=(const T& t) const {
+				set(_ent, t);
+				return *this;
+			}
+		private:
+			ent_type _ent;
+		};
+
+		template <class ...Args>
+		static void emplace(ent_type e, Args&&... args) { set(e, make<T>(std::forward<Args>(args)...)); }
+		static void add(ent_type e, const T& t) { set(e, t); }
+		static void del(ent_type e) { set(e, T{}); }
+		static Ref get(ent_type e) { return Ref(e); }
+		static void reserve(id_type maxId, size_type) {
+			for (auto& p : s()._planes)
+				p.ensure(maxId / WordBits + 1);
+		}
+
+		static T value(ent_type e) {
+			const index_type w = e.id / WordBits;
+			unsigned char bytes[Width] = {};
+			for (index_type k = 0; k < Width; ++k)
+				if (w < s()._planes[k].size())
+					bytes[k] = (s()._planes[k][w] >> (e.id % WordBits)) & 1;
+			T t;
+			memcpy(&t, bytes, Width);
+			return t;
+		}
+		static void set(ent_type e, const T& t) {
+			unsigned char bytes[Width];
+			memcpy(bytes, &t, Width);
+			const index_type w = e.id / WordBits;
+			const word_type bit = word_type{1} << (e.id % WordBits);
+			for (index_type k = 0; k < Width; ++k) {
+				auto& p = s()._planes[k];
+				while (p.size() <= w)
+					p.push(0);
+				p[w] = bytes[k] != 0 ? p[w] | bit : p[w] & ~bit;
+			}
+		}
+		// word w of plane k holds flag k of ids w*64 .. w*64+63
+		static Span<word_type> plane(index_type k) {
+			return {&s()._planes[k][0], s()._planes[k].size()};
+		}
+	private:
+		static void save(SnapshotWriter& w, id_type) {
+			for (auto& p : s()._planes) {
+				const std::uint32_t n = p.size();
+				w.write(n);
+				if (n > 0)
+					w.write(&p[0], sizeof(word_type)*n);
+			}
+		}
+		static bool load(SnapshotReader& r, bool apply) {
+			for (auto& p : s()._planes) {
+				std::uint32_t n;
+				if (!r.read(n))
+					return false;
+				const word_type* words = static_cast<const word_type*>(r.read(sizeof(word_type)*n));
+				if (words == nullptr || (apply && !p.assign(words, n)))
+					return false;
+			}
+			return true;
+		}
+		static void clear() {
+			for (auto& p : s()._planes)
+				p.clear();
+		}
+		static void memory(MemoryStats& m) {
+			m.kind = "bits";
+			m.capacity = s()._planes[0].capacity() * WordBits;
+			m.peak = s()._planes[0].size() * WordBits;
+			for (auto& p : s()._planes) {
+				m.reserved += p.reservedBytes();
+				m.touched += p.touchedBytes();
+			}
+		}
+
+		friend class Registry;
+		struct State {
+			Bag<word_type,Params.InitialEntities/WordBits+1> _planes[Width];
+		};
+		static inline State _global;
+		__attribute__((always_inline))
+		static State& s() {
+			return Registry::resolve<BitStorage>(Registry::StorageSlot + componentIndex<T>());
+		}
+
+		static inline StorageCallbacks callbacks{del, nullptr, memory, save, load, clear};
+
+		__attribute__((used))
+		static inline StorageRegister<T> reg{callbacks};
+	};
+
+	// empty components are only a mask bit; small trivially copyable ones are
+	// indexed by id; the rest are packed, so a 10M-slot bag of a large or
+	// non-relocatable type is never reserved. Specialize (or BAGEL_STORAGE) to override
+	template <class T>
+	struct Storage final : NoInstance {
+		using type =
+			std::conditional_t<std::is_empty_v<T>, TaggedStorage<T>,
+			std::conditional_t<(BitWidth<T>::value > 0), BitStorage<T>,
+			std::conditional_t<std::is_trivially_copyable_v<T> && sizeof(T) <= std::size_t(Params.SparseMaxSize),
+				SparseStorage<T>, PackedStorage<T>>>>;
+	};
+
+	template <class> struct IsPacked : std::false_type {};
+	template <class T> struct IsPacked<PackedStorage<T>> : std::true_type {};
+
+	class SingleMask final
+	{
+	public:
+		using bit_type = mask_type;
+		static constexpr size_type Words = 1;
+		static constexpr bit_type bit(index_type idx) { return static_cast<mask_type>(mask_type{1}<<idx); }
+
+		constexpr void set(const bit_type b) { _mask |= b; }
+		constexpr void set(const SingleMask m) { _mask |= m._mask; }
+
+		constexpr void clear(const bit_type b) { _mask &= ~b; }
+		void clear() { _mask = 0; }
+
+		constexpr bool test(const bit_type b) const { return _mask & b; }
+		constexpr bool test(const SingleMask m) const { return (_mask & m._mask) == m._mask; }
+		constexpr bool any(const SingleMask m) const { return _mask & m._mask; }
+		bool operator==(const SingleMask m) const { return _mask == m._mask; }
+
+		const mask_type* data() const { return &_mask; }
+
+		index_type ctz() const { return _mask ? __builtin_ctzll(_mask) : -1; }
+	private:
+		mask_type	_mask{0};
+	};
+	class MultiMask final
+	{
+	public:
+		using bit_type = struct {
+			const index_type	index;
+			const mask_type		mask;
+		};
+		static constexpr size_type Words = (Params.MaxComponents-1)/BitsetWidth + 1;
+		static constexpr bit_type bit(index_type idx) {
+			return {idx/BitsetWidth, static_cast<mask_type>(mask_type{1}<<(idx%BitsetWidth))};
+		}
+
+		constexpr void set(const bit_type& b) { _masks[b.index] |= b.mask; }
+		constexpr void set(const MultiMask& m) {
+			for (index_type i = 0; i < Size; ++i)
+				_masks[i] |= m._masks[i];
+		}
+
+		constexpr void clear(const bit_type& b) { _masks[b.index] &= ~b.mask; }
+		void clear() { memset(_masks, 0, sizeof(_masks)); }
+
+		constexpr bool test(const bit_type& b) const { return _masks[b.index] & b.mask; }
+		constexpr bool test(const MultiMask& m) const {
+			for (index_type i = 0; i < Size; ++i)
+				if ((_masks[i] & m._masks[i]) != m._masks[i])
+					return false;
+			return true;
+		}
+		constexpr bool any(const MultiMask& m) const {
+			for (index_type i = 0; i < Size; ++i)
+				if (_masks[i] & m._masks[i])
+					return true;
+			return false;
+		}
+		bool operator==(const MultiMask& m) const {
+			return memcmp(_masks, m._masks, sizeof(_masks)) == 0;
+		}
+
+		const mask_type* data() const { return _masks; }
+
+		index_type ctz() const {
+			for (index_type i = 0; i < Size; ++i) {
+				if (_masks[i]) {
+					int c = __builtin_ctzll(_masks[i]);
+					return c + i*BitsetWidth;
+				}
+			}
+			return -1;
+		}
+	private:
+		static constexpr size_type	Size = Words;
+		mask_type					_masks[Size] ={};
+	};
+	using Mask = std::conditional_t<Params.MaxComponents<=BitsetWidth, SingleMask, MultiMask>;
+
+	class MaskScan final : NoInstance
+	{
+		static constexpr size_type W = Mask::Words;
+	public:
+		using Kernel = size_type (*)(const mask_type*, size_type, id_type,
+			const mask_type*, const mask_type*, ent_type*);
+
+		static size_type run(const Mask* masks, size_type n, id_type first,
+			const Mask& required, const Mask& excluded, ent_type* out) {
+			return kernel()(masks[0].data(), n, first, required.data(), excluded.data(), out);
+		}
+		static Kernel kernel() {
+			static const Kernel k = select();
+			return k;
+		}
+
+		static size_type scalar(const mask_type* m, size_type n, id_type first,
+			const mask_type* req, const mask_type* exc, ent_type* out) {
+			size_type count = 0;
+			for (index_type i = 0; i < n; ++i, m += W) {
+				mask_type miss = 0;
+				for (index_type w = 0; w < W; ++w)
+					miss |= ((m[w] & req[w]) ^ req[w]) | (m[w] & exc[w]);
+				if (miss == 0)
+					out[count++] = {id_type(first + i)};
+			}
+			return count;
+		}
+#if defined(__x86_64__)
+		__attribute__((target("sse2")))
+		static size_type sse2(const mask_type* m, size_type n, id_type first,
+			const mask_type* req, const mask_type* exc, ent_type* out) {
+			constexpr size_type PerReg = 2 / W;
+			if constexpr (PerReg == 0)
+				return scalar(m, n, first, req, exc, out);
+			const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(repeat<2>(req).data));
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(repeat<2>(exc).data));
+			size_type count = 0;
+			index_type i = 0;
+			for (; i + PerReg <= n; i += PerReg) {
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m + i*W));
+				const __m128i t = _mm_or_si128(_mm_xor_si128(_mm_and_si128(v, r), r), _mm_and_si128(v, x));
+				const int z = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(t, _mm_setzero_si128())));
+				if (z == 0)
+					continue;
+				// two 32-bit lanes per word, W words per entity
+				for (index_type e = 0; e < PerReg; ++e) {
+					constexpr int Lanes = (1 << (2*W)) - 1;
+					if (((z >> (e*2*W)) & Lanes) == Lanes)
+						out[count++] = {id_type(first + i + e)};
+				}
+			}
+			return count + scalar(m + i*W, n - i, first + i, req, exc, out + count);
+		}
+		__attribute__((target("avx2")))
+		static size_type avx2(const mask_type* m, size_type n, id_type first,
+			const mask_type* req, const mask_type* exc, ent_type* out) {
+			constexpr size_type PerReg = 4 / W;
+			if constexpr (PerReg == 0)
+				return scalar(m, n, first, req, exc, out);
+			const __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(repeat<4>(req).data));
+			const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(repeat<4>(exc).data));
+			size_type count = 0;
+			index_type i = 0;
+			for (; i + 2*PerReg <= n; i += 2*PerReg) {
+				const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m + i*W));
+				const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m + (i+PerReg)*W));
+				const __m256i t0 = _mm256_or_si256(_mm256_xor_si256(_mm256_and_si256(v0, r), r), _mm256_and_si256(v0, x));
+				const __m256i t1 = _mm256_or_si256(_mm256_xor_si256(_mm256_and_si256(v1, r), r), _mm256_and_si256(v1, x));
+				const int z =
+					_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t0, _mm256_setzero_si256()))) |
+					_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t1, _mm256_setzero_si256()))) << 4;
+				if (z == 0)
+					continue;
+				for (index_type e = 0; e < 2*PerReg; ++e) {
+					constexpr int Lanes = (1 << W) - 1;
+					if (((z >> (e*W)) & Lanes) == Lanes)
+						out[count++] = {id_type(first + i + e)};
+				}
+			}
+			return count + scalar(m + i*W, n - i, first + i, req, exc, out + count);
+		}
+#endif
+	private:
+		template <size_type N>
+		struct Words { mask_type data[N]; };
+		template <size_type N>
+		static Words<N> repeat(const mask_type* m) {
+			Words<N> r{};
+			for (index_type i = 0; i < N; ++i)
+				r.data[i] = m[i % W];
+			return r;
+		}
+		static Kernel select() {
+#if defined(__x86_64__)
+			if constexpr (sizeof(mask_type) == 8 && (W == 1 || W == 2 || W == 4)) {
+				__builtin_cpu_init();
+				if (__builtin_cpu_supports("avx2"))
+					return avx2;
+				if constexpr (W <= 2)
+					return sse2;
+			}
+#endif
+			return scalar;
+		}
+	};
+
+	// a compile-time list of components; BAGEL_COMPONENTS(List) gives its
+	// members constexpr indices [0,n), so masks of them fold to constants.
+	// One list per program: a second one would reuse the same indices, which
+	// storage registration detects and aborts on
+	template <class ...Ts>
+	struct Components final : NoInstance
+	{
+		static_assert(sizeof...(Ts) <= Params.MaxComponents, "More components than Params.MaxComponents");
+		template <class T>
+		static constexpr bool contains = (std::is_same_v<T,Ts> || ...);
+		template <class T>
+		static constexpr index_type index = indexOf<T,Ts...>();
+	};
+	template <class T, class = void>
+	struct ComponentIndex { static constexpr index_type value = -1; };
+
+	#define BAGEL_COMPONENTS(List) \
+		template <class T> struct bagel::ComponentIndex<T, std::enable_if_t<List::contains<T>>> { \
+			static constexpr bagel::index_type value = List::index<T>; \
+		}
+
+	// unlisted components are numbered at first use, from MaxComponents-1 down
+	// one counter for the whole program, so every translation unit agrees on the indices
+	inline std::atomic<index_type> compCounter{-1};
+	// one past the highest listed index registered so far
+	inline std::atomic<index_type> listedEnd{0};
+	template <class T, bool = (ComponentIndex<T>::value >= 0)>
+	struct Component final : NoInstance
+	{
+		// template statics initialize in no particular order, so other static
+		// initializers (storage registration) must go through index()
+		static index_type index() {
+			static const index_type i = [] {
+				const index_type i = Params.MaxComponents - 2 - compCounter.fetch_add(1, std::memory_order_relaxed);
+				if (i < listedEnd.load(std::memory_order_relaxed) || i < 0)
+					std::abort(); // more components than Params.MaxComponents
+				return i;
+			}();
+			return i;
+		}
+		static inline const index_type		Index = index();
+		static inline const Mask::bit_type	Bit = Mask::bit(index());
+	};
+	template <class T>
+	struct Component<T,true> final : NoInstance
+	{
+		static constexpr index_type index() { return ComponentIndex<T>::value; }
+		static constexpr index_type			Index = index();
+		static constexpr Mask::bit_type		Bit = Mask::bit(index());
+	};
+	template <class T>
+	index_type componentIndex() { return Component<T>::Index; }
+
+	template <class Required, class Excluded = TypeList<>, class Optional = TypeList<>>
+	class View;
+	template <class T, class ...Ts>
+	class Group;
+
+	// one record per structural change: adds, removals and destruction
+	struct AddedMask {
+		Mask prev;
+		Mask next;
+		ent_type e;
+		bool destroyed = false;
+	};
+
+	class Archetypes final : NoInstance
+	{
+	public:
+		struct Location {
+			index_type	archetype;
+			index_type	row;
+		};
+		struct Archetype : NoCopy {
+			Mask					mask;
+			size_type				capacity = 0;
+			size_type				size = 0;
+			size_type				count = 0;
+			size_type				chunkBytes = 0;
+			index_type				comps[Params.MaxComponents];
+			size_type				offsets[Params.MaxComponents];
+			index_type				addEdge[Params.MaxComponents];
+			index_type				delEdge[Params.MaxComponents];
+			DynamicBag<unsigned char*,4>	chunks;
+
+			~Archetype() {
+				for (index_type i = 0; i < chunks.size(); ++i)
+					Params.Deallocate(chunks[i]);
+			}
+			ent_type* entities(index_type chunk) const {
+				return reinterpret_cast<ent_type*>(chunks[chunk]);
+			}
+			template <class T>
+			T* column(index_type chunk) const {
+				return reinterpret_cast<T*>(chunks[chunk] + offsets[Component<T>::Index]);
+			}
+			size_type chunkSize(index_type chunk) const {
+				return std::min(capacity, size - chunk*capacity);
+			}
+			size_type chunkCount() const {
+				return (size + capacity - 1) / capacity;
+			}
+		};
+
+		template <class T>
+		static void add(ent_type e, const T& t) {
+			_sizes[Component<T>::Index] = sizeof(T);
+			if (s()._archetypes.size() == 0)
+				create(Mask{});
+			if (e.id >= s()._locsSize) {
+				s()._locs.ensure(e.id+1);
+				for (; s()._locsSize <= e.id; ++s()._locsSize)
+					s()._locs[s()._locsSize] = {0, 0};
+			}
+			const index_type src = s()._locs[e.id].archetype;
+			if (s()._archetypes[src]->mask.test(Component<T>::Bit)) {
+				get<T>(e) = t;
+				return;
+			}
+			const index_type dst = addEdge(src, Component<T>::Index);
+			move(e, src, dst);
+			get<T>(e) = t;
+		}
+		static void del(ent_type e, index_type comp) {
+			if (e.id >= s()._locsSize)
+				return;
+			const index_type src = s()._locs[e.id].archetype;
+			if (src == 0 || !s()._archetypes[src]->mask.test(Mask::bit(comp)))
+				return;
+			move(e, src, delEdge(src, comp));
+		}
+		template <class T>
+		static T& get(ent_type e) {
+			State& st = s();
+			const Location& loc = st._locs[e.id];
+			const Archetype& a = *st._archetypes[loc.archetype];
+			return a.column<T>(loc.row / a.capacity)[loc.row % a.capacity];
+		}
+
+		template <class ...Ts, class F>
+		static void eachChunk(F&& f) {
+			Mask required;
+			(required.set(Component<Ts>::Bit), ...);
+			for (index_type i = 1; i < s()._archetypes.size(); ++i) {
+				const Archetype& a = *s()._archetypes[i];
+				if (!a.mask.test(required))
+					continue;
+				for (index_type c = 0; c < a.chunkCount(); ++c)
+					f(a.chunkSize(c), a.entities(c), a.template column<Ts>(c)...);
+			}
+		}
+		template <class ...Ts, class F>
+		static void each(F&& f) {
+			eachChunk<Ts...>([&f](size_type n, const ent_type* ents, Ts*... cols) {
+				for (index_type r = 0; r < n; ++r)
+					f(ents[r], cols[r]...);
+			});
+		}
+
+		static size_type archetypeCount() { return s()._archetypes.size(); }
+		static const Archetype& archetype(index_type i) { return *s()._archetypes[i]; }
+		static const Location& location(ent_type e) { return s()._locs[e.id]; }
+
+		// a column's share of the chunks; chunks are never freed, so allocated
+		// rows are the peak
+		static void memory(index_type comp, MemoryStats& m) {
+			m.kind = "archetype";
+			for (index_type i = 1; i < s()._archetypes.size(); ++i) {
+				const Archetype& a = *s()._archetypes[i];
+				if (!a.mask.test(Mask::bit(comp)))
+					continue;
+				const size_type rows = a.chunks.size() * a.capacity;
+				m.capacity += rows;
+				m.reserved += std::size_t(rows) * _sizes[comp];
+			}
+			m.peak = m.capacity;
+			m.touched = m.reserved;
+		}
+		// locations, entity columns, padding and the archetypes themselves
+		static void memory(MemoryStats& m) {
+			m.name = "Archetypes";
+			m.kind = "world";
+			m.elemSize = sizeof(Location);
+			m.capacity = s()._locs.capacity();
+			m.live = m.peak = s()._locsSize;
+			m.reserved = s()._locs.reservedBytes() + s()._archetypes.reservedBytes();
+			m.touched = s()._locs.touchedBytes() + s()._archetypes.touchedBytes();
+			for (index_type i = 0; i < s()._archetypes.size(); ++i) {
+				const Archetype& a = *s()._archetypes[i];
+				std::size_t columns = 0;
+				for (index_type c = 0; c < a.count; ++c)
+					columns += std::size_t(a.capacity) * _sizes[a.comps[c]];
+				const std::size_t overhead = sizeof(Archetype) + a.chunks.reservedBytes() +
+					a.chunks.size() * (a.chunkBytes - columns);
+				m.reserved += overhead;
+				m.touched += overhead;
+			}
+		}
+	private:
+		static index_type find(const Mask& m) {
+			for (index_type i = 0; i < s()._archetypes.size(); ++i)
+				if (s()._archetypes[i]->mask == m)
+					return i;
+			return create(m);
+		}
+		static index_type create(const Mask& m) {
+			Archetype* a = new Archetype;
+			a->mask = m;
+			size_type rowBytes = sizeof(ent_type);
+			for (index_type i = 0; i < Params.MaxComponents; ++i)
+				a->addEdge[i] = a->delEdge[i] = -1;
+			Mask rest = m;
+			for (index_type i = rest.ctz(); i >= 0; rest.clear(Mask::bit(i)), i = rest.ctz()) {
+				a->comps[a->count++] = i;
+				rowBytes += _sizes[i];
+			}
+			a->capacity = std::max(1, Params.ArchetypeChunkSize / rowBytes);
+
+			size_type offset = align(a->capacity * sizeof(ent_type));
+			for (index_type i = 0; i < a->count; ++i) {
+				a->offsets[a->comps[i]] = offset;
+				offset = align(offset + a->capacity * _sizes[a->comps[i]]);
+			}
+			a->chunkBytes = offset;
+			s()._archetypes.push(a);
+			return s()._archetypes.size()-1;
+		}
+		static index_type addEdge(index_type src, index_type comp) {
+			index_type& edge = s()._archetypes[src]->addEdge[comp];
+			if (edge < 0) {
+				Mask m = s()._archetypes[src]->mask;
+				m.set(Mask::bit(comp));
+				edge = find(m);
+			}
+			return edge;
+		}
+		static index_type delEdge(index_type src, index_type comp) {
+			index_type& edge = s()._archetypes[src]->delEdge[comp];
+			if (edge < 0) {
+				Mask m = s()._archetypes[src]->mask;
+				m.clear(Mask::bit(comp));
+				edge = find(m);
+			}
+			return edge;
+		}
+		static void move(ent_type e, index_type src, index_type dst) {
+			Location loc{dst, 0};
+			if (dst != 0) {
+				Archetype& to = *s()._archetypes[dst];
+				loc.row = to.size++;
+				if (loc.row == to.chunks.size()*to.capacity)
+					to.chunks.push(static_cast<unsigned char*>(Params.Allocate(to.chunkBytes)));
+				const index_type chunk = loc.row / to.capacity, slot = loc.row % to.capacity;
+				to.entities(chunk)[slot] = e;
+				if (src != 0) {
+					const Archetype& from = *s()._archetypes[src];
+					const index_type row = s()._locs[e.id].row;
+					const index_type fromChunk = row / from.capacity, fromSlot = row % from.capacity;
+					for (index_type i = 0; i < from.count; ++i) {
+						const index_type c = from.comps[i];
+						if (to.mask.test(Mask::bit(c)))
+							memcpy(to.chunks[chunk] + to.offsets[c] + slot*_sizes[c],
+								from.chunks[fromChunk] + from.offsets[c] + fromSlot*_sizes[c],
+								_sizes[c]);
+					}
+				}
+			}
+			if (src != 0)
+				remove(src, s()._locs[e.id].row);
+			s()._locs[e.id] = loc;
+		}
+		static void remove(index_type arch, index_type row) {
+			Archetype& a = *s()._archetypes[arch];
+			const index_type last = --a.size;
+			if (row == last)
+				return;
+			const index_type chunk = row / a.capacity, slot = row % a.capacity;
+			const index_type lastChunk = last / a.capacity, lastSlot = last % a.capacity;
+			for (index_type i = 0; i < a.count; ++i) {
+				const index_type c = a.comps[i];
+				memcpy(a.chunks[chunk] + a.offsets[c] + slot*_sizes[c],
+					a.chunks[lastChunk] + a.offsets[c] + lastSlot*_sizes[c],
+					_sizes[c]);
+			}
+			const ent_type moved = a.entities(lastChunk)[lastSlot];
+			a.entities(chunk)[slot] = moved;
+			s()._locs[moved.id].row = row;
+		}
+		static size_type align(size_type s) {
+			constexpr size_type A = alignof(std::max_align_t);
+			return (s + A - 1) / A * A;
+		}
+
+		struct ArchetypeBag : DynamicBag<Archetype*,16> {
+			~ArchetypeBag() {
+				for (index_type i = 0; i < size(); ++i)
+					delete (*this)[i];
+			}
+		};
+
+		static inline size_type							_sizes[Params.MaxComponents] = {};
+		friend class Registry;
+		struct State {
+			ArchetypeBag						_archetypes;
+			Bag<Location,Params.InitialEntities,Params.HugePages>	_locs;
+			size_type							_locsSize = 0;
+		};
+		static State _global;
+		__attribute__((always_inline))
+		static State& s() { return Registry::resolve<Archetypes>(Registry::ArchetypeSlot); }
+	};
+	inline Archetypes::State Archetypes::_global;
+
+	template <class T>
+	class ArchetypeStorage final : NoInstance
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "ArchetypeStorage requires trivially copyable components");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "ArchetypeStorage requires default alignment");
+	public:
+		template <class ...Args>
+		static void emplace(ent_type e, Args&&... args) { Archetypes::add(e, make<T>(std::forward<Args>(args)...)); }
+		static void add(ent_type e, const T& t) { Archetypes::add(e, t); }
+		static void del(ent_type e) { Archetypes::del(e, Component<T>::Index); }
+		static T& get(ent_type e) { return Archetypes::get<T>(e); }
+		static void reserve(id_type, size_type) {}
+	private:
+		static void memory(MemoryStats& m) { Archetypes::memory(Component<T>::Index, m); }
+
+		static inline StorageCallbacks callbacks{del, nullptr, memory};
+
+		__attribute__((used))
+		static inline StorageRegister<T> reg{callbacks};
+	};
+
+	class World final : NoInstance
+	{
+		using BitPlane = Bag<word_type,Params.InitialEntities/WordBits+1>;
+	public:
+		static ent_type createEntity() {
+			if (s()._ids.size() > 0)
+				return s()._ids.pop();
+			if (s()._maxId.id == std::numeric_limits<id_type>::max())
+				std::abort(); // out of ids, raise Params.IdBits
+			s()._masks.push(Mask{});
+			s()._gens.push(0);
+			return {++s()._maxId.id};
+		}
+		static void createEntities(Span<ent_type> out) {
+			index_type i = 0;
+			for (; i < out.size && s()._ids.size() > 0; ++i)
+				out[i] = s()._ids.pop();
+			if (std::int64_t{s()._maxId.id} + out.size - i > std::numeric_limits<id_type>::max())
+				std::abort(); // out of ids, raise Params.IdBits
+			s()._masks.ensure(s()._maxId.id + 1 + out.size - i);
+			s()._gens.ensure(s()._maxId.id + 1 + out.size - i);
+			for (; i < out.size; ++i) {
+				s()._masks.push(Mask{});
+				s()._gens.push(0);
+				out[i] = {++s()._maxId.id};
+			}
+		}
+		template <class ...Ts>
+		static void createEntities(Span<ent_type> out, const Ts&... ts) {
+			createEntities(out);
+			if constexpr (sizeof...(Ts) > 0)
+				addComponents(out, ts...);
+		}
+		// a stale handle is ignored, so destroying twice is harmless
+		static void destroyEntity(ent_type ent) {
+			if (!valid(ent))
+				return;
+			if constexpr (Params.CallbackOnDestroy || Params.ComponentBitsets || Params.ChangeTracking) {
+				Mask m = s()._masks[ent.id];
+				int ctz = m.ctz(); // count-trailing-zeros
+				while (ctz >= 0) {
+					if constexpr (Params.CallbackOnDestroy)
+						if (_callbacks[ctz].destroy != nullptr)
+							_callbacks[ctz].destroy(ent);
+					if constexpr (Params.ComponentBitsets)
+						clearBit(ctz, ent);
+					if constexpr (Params.ChangeTracking)
+						clearVersion(ctz, ent);
+					m.clear(Mask::bit(ctz));
+					ctz = m.ctz();
+				}
+			}
+			if constexpr (Params.AggregateUpdates)
+				s()._added.push({s()._masks[ent.id],Mask{},ent,true});
+			s()._masks[ent.id].clear();
+			s()._ids.push({ent.id, ++s()._gens[ent.id]});
+		}
+		// works one component at a time: each storage deletes its share in one
+		// call, and bitset words and versions of that component stay hot.
+		// Destroying a handle bumps its generation first, so repeated and stale
+		// handles are skipped like in destroyEntity
+		static void destroyEntities(Span<const ent_type> ents) {
+			State& st = s();
+			st._batch.clear();
+			Mask all;
+			for (ent_type e : ents) {
+				if (!valid(e))
+					continue;
+				++st._gens[e.id];
+				st._batch.push(e);
+				all.set(st._masks[e.id]);
+			}
+			const Span<const ent_type> batch{&st._batch[0], st._batch.size()};
+			for (index_type c = all.ctz(); c >= 0; all.clear(Mask::bit(c)), c = all.ctz()) {
+				st._victims.clear();
+				for (ent_type e : batch)
+					if (st._masks[e.id].test(Mask::bit(c)))
+						st._victims.push(e);
+				const Span<const ent_type> victims{&st._victims[0], st._victims.size()};
+				if constexpr (Params.CallbackOnDestroy) {
+					if (_callbacks[c].destroyAll != nullptr)
+						_callbacks[c].destroyAll(victims);
+					else if (_callbacks[c].destroy != nullptr)
+						for (ent_type e : victims)
+							_callbacks[c].destroy(e);
+				}
+				for (ent_type e : victims) {
+					if constexpr (Params.ComponentBitsets)
+						clearBit(c, e);
+					if constexpr (Params.ChangeTracking)
+						clearVersion(c, e);
+				}
+			}
+			for (ent_type e : batch) {
+				if constexpr (Params.AggregateUpdates)
+					st._added.push({st._masks[e.id],Mask{},e,true});
+				st._masks[e.id].clear();
+				st._ids.push({e.id, st._gens[e.id]});
+			}
+		}
+		static const Mask& mask(ent_type e) {
+			return s()._masks[e.id];
+		}
+		static ent_type maxId() { return s()._maxId; }
+
+		// false once the entity was destroyed, even if its id was reused
+		static bool valid(ent_type e) {
+			return e.id >= 0 && e.id <= s()._maxId.id && s()._gens[e.id] == e.gen;
+		}
+		// the current handle of an id, for loops over ids
+		static ent_type entity(id_type id) { return {id, s()._gens[id]}; }
+
+		template <class T>
+		static decltype(auto) getComponent(ent_type e) {
+			return Storage<T>::type::get(e);
+		}
+
+		template <class T, class ...Args>
+		static void emplaceComponent(ent_type e, Args&&... args) {
+			Mask prev = s()._masks[e.id];
+
+			s()._masks[e.id].set(Component<T>::Bit);
+			Storage<T>::type::emplace(e, std::forward<Args>(args)...);
+			if constexpr (Params.ComponentBitsets)
+				setBit(Component<T>::Index, e);
+			if constexpr (Params.ChangeTracking)
+				markChanged<T>(e);
+
+			if constexpr (Params.AggregateUpdates) {
+				Mask next = s()._masks[e.id];
+				s()._added.push({prev,next,e});
+			}
+		}
+		template <class T>
+		static void addComponent(ent_type e, const T& t) {
+			emplaceComponent<T>(e, t);
+		}
+		template <class T, std::enable_if_t<!std::is_reference_v<T>,int> = 0>
+		static void addComponent(ent_type e, T&& t) {
+			emplaceComponent<T>(e, std::move(t));
+		}
+		template <class T, class...Ts>
+		static void addComponents(ent_type e, T&& t, Ts&&... ts) {
+			addComponent(e, std::forward<T>(t));
+			if constexpr (sizeof...(Ts)>0)
+				addComponents(e, std::forward<Ts>(ts)...);
+		}
+
+		template <class E, class ...Ts>
+		static void addComponents(Span<E> ents, const Ts&... ts) {
+			static_assert(std::is_same_v<std::remove_const_t<E>, ent_type>);
+			if (ents.size == 0)
+				return;
+			if constexpr (Params.AggregateUpdates)
+				s()._added.ensure(s()._added.size() + ents.size);
+			id_type maxId = 0;
+			for (const ent_type e : ents) {
+				Mask& m = s()._masks[e.id];
+				const Mask prev = m;
+				(m.set(Component<Ts>::Bit), ...);
+				if constexpr (Params.AggregateUpdates)
+					s()._added.push({prev,m,e});
+				maxId = std::max(maxId, e.id);
+			}
+			(addColumn(ents, maxId, ts), ...);
+		}
+
+		template <class T>
+		static void delComponent(ent_type e) {
+			if (!s()._masks[e.id].test(Component<T>::Bit))
+				return;
+			if constexpr (Params.AggregateUpdates) {
+				Mask next = s()._masks[e.id];
+				next.clear(Component<T>::Bit);
+				s()._added.push({s()._masks[e.id],next,e});
+			}
+			s()._masks[e.id].clear(Component<T>::Bit);
+			Storage<T>::type::del(e);
+			if constexpr (Params.ComponentBitsets)
+				clearBit(Component<T>::Index, e);
+			if constexpr (Params.ChangeTracking)
+				dropVersion(Component<T>::Index, e);
+		}
+		template <class T, class ...Ts>
+		static void delComponents(ent_type e) {
+			delComponent<T>(e);
+			if constexpr (sizeof...(Ts)>0)
+				delComponents<Ts...>(e);
+		}
+
+		template <class ...Ts>
+		static View<TypeList<Ts...>> view() { return {}; }
+		template <class T, class ...Ts>
+		static Group<T,Ts...> group() { return {}; }
+		template <class T, class Key>
+		static void sort(Key&& key, SortMode mode = SortMode::Full) {
+			static_assert(IsPacked<typename Storage<T>::type>::value, "sort() requires a PackedStorage component");
+			PackedStorage<T>::sort(std::forward<Key>(key), mode);
+		}
+
+		static size_type scan(const Mask& required, const Mask& excluded, ent_type* out) {
+			return scan(0, s()._maxId.id + 1, required, excluded, out);
+		}
+		static size_type scan(id_type first, size_type n, const Mask& required, const Mask& excluded, ent_type* out) {
+			const size_type found = MaskScan::run(&s()._masks[first], n, first, required, excluded, out);
+			for (index_type i = 0; i < found; ++i)
+				out[i].gen = s()._gens[out[i].id];
+			return found;
+		}
+
+		// empty until the component's first entity
+		static Span<const word_type> bits(index_type comp) {
+			const BitPlane* b = s()._bits[comp];
+			if (b == nullptr)
+				return {nullptr, 0};
+			return {&(*b)[0], b->size()};
+		}
+		static word_type bitWord(index_type comp, index_type w) {
+			const BitPlane* b = s()._bits[comp];
+			return b != nullptr && w < b->size() ? (*b)[w] : 0;
+		}
+
+		template <class T>
+		static void registerStorage(StorageCallbacks& cb) {
+			const index_type c = Component<T>::index();
+			if constexpr (ComponentIndex<T>::value >= 0) {
+				index_type end = listedEnd.load(std::memory_order_relaxed);
+				while (end < c+1 && !listedEnd.compare_exchange_weak(end, c+1, std::memory_order_relaxed)) {}
+				if (c >= Params.MaxComponents - 1 - compCounter.load(std::memory_order_relaxed))
+					std::abort(); // unlisted components took the listed range
+			}
+			StorageCallbacks& slot = _callbacks[c];
+			if (slot.key != 0 && slot.key != typeKey<T>())
+				std::abort(); // two components share an index: more than one BAGEL_COMPONENTS list?
+			slot = cb;
+			slot.key = typeKey<T>();
+			slot.size = sizeof(T);
+			slot.name = typeName<T>();
+		}
+
+		// live counts come from the entity masks, so this walks every id
+		static MemoryReport memoryReport() {
+			MemoryReport r;
+			size_type live[Params.MaxComponents] = {};
+			for (id_type id = 0; id <= s()._maxId.id; ++id) {
+				Mask m = s()._masks[id];
+				for (index_type c = m.ctz(); c >= 0; m.clear(Mask::bit(c)), c = m.ctz())
+					++live[c];
+			}
+			for (index_type c = 0; c < Params.MaxComponents; ++c) {
+				if (_callbacks[c].memory == nullptr)
+					continue;
+				MemoryStats& m = r.storages.emplace();
+				m.name = _callbacks[c].name;
+				m.elemSize = _callbacks[c].size;
+				m.live = live[c];
+				_callbacks[c].memory(m);
+			}
+			table(r.world.emplace(), "World::masks", s()._masks, s()._maxId.id+1 - s()._ids.size());
+			table(r.world.emplace(), "World::gens", s()._gens, s()._maxId.id+1);
+			table(r.world.emplace(), "World::ids", s()._ids, s()._ids.size());
+			table(r.world.emplace(), "World::added", s()._added, s()._added.size());
+			if constexpr (Params.ComponentBitsets) {
+				MemoryStats& m = r.world.emplace();
+				for (index_type c = 0; c < Params.MaxComponents; ++c)
+					if (s()._bits[c] != nullptr)
+						table(m, "World::bits", *s()._bits[c], m.live + s()._bits[c]->size());
+			}
+			if constexpr (Params.ChangeTracking) {
+				MemoryStats& versions = r.world.emplace();
+				MemoryStats& changed = r.world.emplace();
+				for (index_type c = 0; c < Params.MaxComponents; ++c) {
+					table(versions, "World::versions", s()._versions[c], versions.live + live[c]);
+					table(changed, "World::changed", s()._changed[c], changed.live + s()._changed[c].size());
+				}
+			}
+			Archetypes::memory(r.world.emplace());
+			return r;
+		}
+
+		static size_type sizeAdded() { return s()._added.size(); }
+		static const AddedMask& getAdded(int i) { return s()._added[i]; }
+
+		// a component is changed in the frame it was added or marked; the
+		// version slot exists from add, so marking is safe on disjoint entities
+		template <class T>
+		static void markChanged(ent_type e) {
+			static_assert(Params.ChangeTracking, "Enable Params.ChangeTracking");
+			std::uint32_t& v = s()._versions[Component<T>::Index][e.id];
+			if (v == s()._frame)
+				return;
+			// ~frame: T was removed after being listed, maybe by this same handle
+			const bool removed = v == ~s()._frame;
+			v = s()._frame;
+			std::lock_guard<std::mutex> lock(s()._changedLock);
+			auto& list = s()._changed[Component<T>::Index];
+			if (removed)
+				for (index_type i = list.size()-1; i >= 0; --i)
+					if (list[i].id == e.id && list[i].gen == e.gen)
+						return;
+			list.push(e);
+		}
+		template <class T>
+		static decltype(auto) getMut(ent_type e) {
+			markChanged<T>(e);
+			return getComponent<T>(e);
+		}
+		template <class T>
+		static bool changed(ent_type e) { return changed(Component<T>::Index, e); }
+		static bool changed(index_type comp, ent_type e) {
+			return s()._versions[comp].get(e.id) == s()._frame;
+		}
+		template <class T>
+		static Span<const ent_type> changed() {
+			const auto& list = s()._changed[Component<T>::Index];
+			return {&list[0], list.size()};
+		}
+		static std::uint32_t frame() { return s()._frame; }
+
+		static void registerReactive(void (*sync)(void*), void (*rescan)(void*), void* system) {
+			s()._reactive.push({sync, rescan, system});
+		}
+		static void unregisterReactive(void* system) {
+			for (index_type i = 0; i < s()._reactive.size(); ++i) {
+				if (s()._reactive[i].system == system) {
+					s()._reactive[i] = s()._reactive[s()._reactive.size()-1];
+					s()._reactive.pop();
+					return;
+				}
+			}
+		}
+
+		// entity masks, free ids, then one section per storage holding its raw
+		// arrays and bitset words; false if a live component's storage cannot be
+		// saved (archetype, non trivially copyable) or the file cannot be written
+		static bool saveSnapshot(const char* path) {
+			Mask all;
+			for (id_type id = 0; id <= s()._maxId.id; ++id)
+				all.set(s()._masks[id]);
+			SnapshotHeader h;
+			for (index_type c = 0; c < Params.MaxComponents; ++c) {
+				if (_callbacks[c].save != nullptr)
+					++h.sections;
+				else if (all.test(Mask::bit(c)))
+					return false;
+			}
+			std::FILE* f = std::fopen(path, "wb");
+			if (f == nullptr)
+				return false;
+			SnapshotWriter w(f);
+			h.maxId = s()._maxId.id;
+			h.freeIds = s()._ids.size();
+			w.write(h);
+			if (s()._maxId.id >= 0) {
+				w.write(&s()._masks[0], sizeof(Mask)*(s()._maxId.id+1));
+				w.write(&s()._gens[0], sizeof(gen_type)*(s()._maxId.id+1));
+			}
+			if (s()._ids.size() > 0)
+				w.write(&s()._ids[0], sizeof(ent_type)*s()._ids.size());
+			for (index_type c = 0; c < Params.MaxComponents && w.ok(); ++c) {
+				if (_callbacks[c].save == nullptr)
+					continue;
+				SnapshotSection sec{_callbacks[c].key, std::uint32_t(c), std::uint32_t(_callbacks[c].size)};
+				if constexpr (Params.ComponentBitsets)
+					sec.bitWords = bits(c).size;
+				// the payload size is patched in once the storage has written it
+				const long at = std::ftell(f);
+				w.write(sec);
+				_callbacks[c].save(w, s()._maxId.id);
+				if constexpr (Params.ComponentBitsets)
+					if (sec.bitWords > 0)
+						w.write(bits(c).data, sizeof(word_type)*sec.bitWords);
+				const long end = std::ftell(f);
+				sec.bytes = end - at - sizeof(sec);
+				if (std::fseek(f, at, SEEK_SET) != 0)
+					break;
+				w.write(sec);
+				std::fseek(f, end, SEEK_SET);
+			}
+			const bool ok = w.ok();
+			return std::fclose(f) == 0 && ok;
+		}
+		// replaces the whole world, copying each array in bulk from the mapped
+		// file; false, with the world untouched, if the file is missing, truncated
+		// or was written by a build with other components or settings. The whole
+		// file is checked before the world is cleared; only arrays that outgrow
+		// fixed capacities (DynamicResize off) fail later, leaving it empty
+		static bool loadSnapshot(const char* path) {
+			const MappedFile file(path);
+			SnapshotReader r(file.data(), file.size());
+			SnapshotHeader h;
+			if (file.data() == nullptr || !r.read(h) || memcmp(h.magic, SnapshotHeader{}.magic, 4) != 0 ||
+				h.version != SnapshotHeader{}.version || h.maskBytes != sizeof(Mask) ||
+				h.entBytes != sizeof(ent_type) || h.maxId < -1 || h.sections > std::uint32_t(Params.MaxComponents))
+				return false;
+			const size_type n = h.maxId + 1;
+			const void* masks = r.read(sizeof(Mask)*n);
+			const void* gens = r.read(sizeof(gen_type)*n);
+			const void* ids = r.read(sizeof(ent_type)*h.freeIds);
+			if (masks == nullptr || gens == nullptr || ids == nullptr)
+				return false;
+
+			struct Section {
+				index_type				comp;
+				const unsigned char*	data;
+				std::size_t				bytes;
+				std::size_t				bitWords;
+			};
+			Section sections[Params.MaxComponents];
+			index_type remap[Params.MaxComponents];
+			std::fill(remap, remap + Params.MaxComponents, -1);
+			bool identity = true;
+			for (index_type i = 0; i < index_type(h.sections); ++i) {
+				SnapshotSection sec;
+				if (!r.read(sec))
+					return false;
+				const void* data = r.read(sec.bytes);
+				index_type c = 0;
+				while (c < Params.MaxComponents && _callbacks[c].key != sec.key)
+					++c;
+				if (data == nullptr || c == Params.MaxComponents || sec.index >= std::uint32_t(Params.MaxComponents) ||
+					_callbacks[c].save == nullptr || std::uint32_t(_callbacks[c].size) != sec.elemSize ||
+					sec.bitWords*sizeof(word_type) > sec.bytes)
+					return false;
+				SnapshotReader payload(static_cast<const unsigned char*>(data), sec.bytes - sec.bitWords*sizeof(word_type));
+				if (!_callbacks[c].load(payload, false))
+					return false;
+				remap[sec.index] = c;
+				identity = identity && index_type(sec.index) == c;
+				sections[i] = {c, static_cast<const unsigned char*>(data), std::size_t(sec.bytes), std::size_t(sec.bitWords)};
+			}
+			// components took other indices in the saving process
+			for (index_type id = 0; !identity && id < n; ++id) {
+				Mask saved;
+				memcpy(&saved, static_cast<const unsigned char*>(masks) + sizeof(Mask)*id, sizeof(Mask));
+				for (index_type b = saved.ctz(); b >= 0; saved.clear(Mask::bit(b)), b = saved.ctz())
+					if (remap[b] < 0)
+						return false;
+			}
+
+			clearWorld();
+			bool ok = s()._masks.assign(static_cast<const Mask*>(masks), n) &&
+				s()._gens.assign(static_cast<const gen_type*>(gens), n) &&
+				s()._ids.assign(static_cast<const ent_type*>(ids), h.freeIds);
+			s()._maxId = {id_type(h.maxId)};
+			for (id_type id = 0; ok && !identity && id <= s()._maxId.id; ++id) {
+				Mask saved = s()._masks[id], m;
+				for (index_type b = saved.ctz(); b >= 0; saved.clear(Mask::bit(b)), b = saved.ctz())
+					m.set(Mask::bit(remap[b]));
+				s()._masks[id] = m;
+			}
+			for (index_type i = 0; ok && i < index_type(h.sections); ++i) {
+				const Section& sec = sections[i];
+				const std::size_t bitBytes = sec.bitWords*sizeof(word_type);
+				SnapshotReader payload(sec.data, sec.bytes - bitBytes);
+				ok = _callbacks[sec.comp].load(payload, true);
+				if constexpr (Params.ComponentBitsets)
+					ok = ok && (sec.bitWords == 0 || bitPlane(sec.comp).assign(
+						reinterpret_cast<const word_type*>(sec.data + sec.bytes - bitBytes), sec.bitWords));
+			}
+			// markChanged relies on the version slot existing from add
+			if constexpr (Params.ChangeTracking)
+				for (id_type id = 0; ok && id <= s()._maxId.id; ++id) {
+					Mask m = s()._masks[id];
+					for (index_type c = m.ctz(); c >= 0; m.clear(Mask::bit(c)), c = m.ctz())
+						s()._versions[c][id] = 0;
+				}
+			if (!ok)
+				clearWorld();
+			for (index_type c = 0; c < Params.MaxComponents; ++c)
+				if (_callbacks[c].loaded != nullptr)
+					_callbacks[c].loaded();
+			for (index_type i = 0; i < s()._reactive.size(); ++i)
+				s()._reactive[i].rescan(s()._reactive[i].system);
+			return ok;
+		}
+
+		static void step() {
+			// reactive systems consume the records before they are dropped
+			for (index_type i = 0; i < s()._reactive.size(); ++i)
+				s()._reactive[i].sync(s()._reactive[i].system);
+			s()._added.clear();
+			if constexpr (Params.ChangeTracking) {
+				for (auto& list : s()._changed)
+					list.clear();
+				++s()._frame;
+			}
+		}
+	private:
+		struct SnapshotHeader {
+			char			magic[4] = {'B','G','L','S'};
+			std::uint32_t	version = 2;
+			std::uint32_t	maskBytes = sizeof(Mask);
+			std::uint32_t	entBytes = sizeof(ent_type);
+			std::int64_t	maxId = -1;
+			std::uint32_t	freeIds = 0;
+			std::uint32_t	sections = 0;
+		};
+		struct SnapshotSection {
+			std::uint64_t	key = 0;
+			std::uint32_t	index = 0;
+			std::uint32_t	elemSize = 0;
+			std::uint64_t	bytes = 0;
+			std::uint64_t	bitWords = 0;
+		};
+
+		// storages that cannot simply be wiped delete their entities one by one
+		static void clearWorld() {
+			Mask all;
+			for (id_type id = 0; id <= s()._maxId.id; ++id)
+				all.set(s()._masks[id]);
+			for (index_type c = all.ctz(); c >= 0; all.clear(Mask::bit(c)), c = all.ctz()) {
+				if (_callbacks[c].clear != nullptr || _callbacks[c].destroy == nullptr)
+					continue;
+				for (ent_type e{0}; e.id <= s()._maxId.id; ++e.id)
+					if (s()._masks[e.id].test(Mask::bit(c)))
+						_callbacks[c].destroy(e);
+			}
+			for (index_type c = 0; c < Params.MaxComponents; ++c) {
+				if (_callbacks[c].clear != nullptr)
+					_callbacks[c].clear();
+				if constexpr (Params.ComponentBitsets)
+					if (s()._bits[c] != nullptr)
+						s()._bits[c]->clear();
+				if constexpr (Params.ChangeTracking) {
+					s()._versions[c].clear();
+					s()._changed[c].clear();
+				}
+			}
+			s()._added.clear();
+			s()._masks.clear();
+			s()._gens.clear();
+			s()._ids.clear();
+			s()._maxId = {-1};
+		}
+
+		template <class E, class T>
+		static void addColumn(Span<E> ents, id_type maxId, const T& t) {
+			using S = typename Storage<T>::type;
+			S::reserve(maxId, ents.size);
+			for (const ent_type e : ents)
+				S::add(e, t);
+			if constexpr (Params.ComponentBitsets)
+				for (const ent_type e : ents)
+					setBit(Component<T>::Index, e);
+			if constexpr (Params.ChangeTracking)
+				for (const ent_type e : ents)
+					markChanged<T>(e);
+		}
+		static BitPlane& bitPlane(index_type comp) {
+			BitPlane*& b = s()._bits[comp];
+			if (b == nullptr)
+				b = new BitPlane;
+			return *b;
+		}
+		static void setBit(index_type comp, ent_type e) {
+			BitPlane& b = bitPlane(comp);
+			const index_type w = e.id / WordBits;
+			while (b.size() <= w)
+				b.push(0);
+			b[w] |= word_type{1} << (e.id % WordBits);
+		}
+		static void clearBit(index_type comp, ent_type e) {
+			BitPlane* b = s()._bits[comp];
+			const index_type w = e.id / WordBits;
+			if (b != nullptr && w < b->size())
+				(*b)[w] &= ~(word_type{1} << (e.id % WordBits));
+		}
+
+		// accumulates, so several bags can share one entry
+		template <class B>
+		static void table(MemoryStats& m, const char* name, const B& bag, size_type live) {
+			m.name = name;
+			m.kind = "world";
+			m.elemSize = sizeof(std::declval<B&>()[0]);
+			m.capacity += bag.capacity();
+			m.live = live;
+			m.peak = m.capacity;
+			m.reserved += bag.reservedBytes();
+			m.touched += bag.touchedBytes();
+		}
+		static void clearVersion(index_type comp, ent_type e) {
+			if (s()._versions[comp].get(e.id) != 0)
+				s()._versions[comp][e.id] = 0;
+		}
+		// a listed component re-added in the same frame is not listed again
+		static void dropVersion(index_type comp, ent_type e) {
+			std::uint32_t& v = s()._versions[comp][e.id];
+			v = v == s()._frame ? ~s()._frame : 0;
+		}
+
+		friend class Registry;
+		template <class, class, class> friend class View;
+
+		static constexpr size_type Tracked = Params.ChangeTracking ? Params.MaxComponents : 0;
+		struct Reactive {
+			void	(*sync)(void*);
+			void	(*rescan)(void*);
+			void*	system;
+		};
+		struct State {
+			PagedBag<std::uint32_t>						_versions[Tracked];
+			Bag<ent_type,Params.InitialPackedSize>		_changed[Tracked];
+			std::mutex									_changedLock;
+			std::uint32_t								_frame = 1;
+
+			// a plane is allocated with its component's first bit, so indices
+			// that are never used cost a pointer instead of a full plane
+			BitPlane*									_bits[Params.ComponentBitsets ? Params.MaxComponents : 0] = {};
+
+			DynamicBag<Reactive,8>						_reactive;
+			DynamicBag<ent_type,64>						_batch;
+			DynamicBag<ent_type,64>						_victims;
+			Bag<AddedMask,Params.IdBagSize>				_added;
+
+			ent_type									_maxId{-1};
+			Bag<Mask,		Params.InitialEntities,Params.HugePages> _masks;
+			Bag<gen_type,	Params.InitialEntities,Params.HugePages> _gens;
+			Bag<ent_type,	Params.IdBagSize>			_ids;
+
+			~State() {
+				if constexpr (Params.ComponentBitsets)
+					for (index_type c = 0; c < Params.MaxComponents; ++c)
+						delete _bits[c];
+			}
+		};
+		static State _global;
+		__attribute__((always_inline))
+		static State& s() { return Registry::resolve<World>(Registry::WorldSlot); }
+
+		// per type, shared by every registry
+		static inline StorageCallbacks _callbacks[Params.MaxComponents] = {};
+	};
+	inline World::State World::_global;
+
+	template <class T>
+	class StorageRegister
+	{
+	public:
+		StorageRegister(StorageCallbacks& cb) {
+			World::registerStorage<T>(cb);
+		}
+	};
+
+	class Entity
+	{
+	public:
+		Entity(ent_type e) : _ent(e) {}
+		ent_type entity() const { return _ent; }
+
+		static Entity create() { return World::createEntity(); }
+		void destroy() const { World::destroyEntity(_ent); }
+
+		const Mask& mask() const { return World::mask(_ent); }
+
+		template <class T> decltype(auto) get() const { return World::getComponent<T>(_ent); }
+		template <class T> decltype(auto) getMut() const { return World::getMut<T>(_ent); }
+		template <class T> void markChanged() const { World::markChanged<T>(_ent); }
+		template <class T> void add(const T& t) const {
+			return World::addComponent<T>(_ent, t);
+		}
+		template <class T, std::enable_if_t<!std::is_reference_v<T>,int> = 0> void add(T&& t) const {
+			return World::addComponent<T>(_ent, std::move(t));
+		}
+		template <class T, class ...Args> void emplace(Args&&... args) const {
+			return World::emplaceComponent<T>(_ent, std::forward<Args>(args)...);
+		}
+		template <class T> void del() const {
+			return World::delComponent<T>(_ent);
+		}
+
+		template <class T, class ...Ts> void addAll(T&& t, Ts&&... ts) const {
+			World::addComponents(_ent, std::forward<T>(t), std::forward<Ts>(ts)...);
+		}
+		template <class T, class ...Ts> void delAll() const {
+			World::delComponents<T,Ts...>(_ent);
 		}
 
 		template <class T> bool has() const { return mask().test(Component<T>::Bit); }
@@ -370,16 +2540,887 @@ namespace bagel
 		ent_type _ent;
 	};
 
+	class CommandBuffer : NoCopy
+	{
+	public:
+		ent_type create() {
+			Command& c = push({id_type(-(++_created))});
+			c.create = true;
+			return c.e;
+		}
+		template <class T>
+		void add(ent_type e, const T& t) {
+			Command& c = push(e);
+			if constexpr (std::is_trivially_copyable_v<T> && alignof(T) <= alignof(std::max_align_t)) {
+				c.apply = [](ent_type e, void* p) { World::addComponent(e, *static_cast<T*>(p)); };
+				memcpy(payload(c, sizeof(T)), &t, sizeof(T));
+			} else {
+				c.apply = [](ent_type e, void* p) {
+					T* t = *static_cast<T**>(p);
+					World::addComponent(e, std::move(*t));
+					delete t;
+				};
+				c.discard = [](void* p) { delete *static_cast<T**>(p); };
+				T* copy = new T(t);
+				memcpy(payload(c, sizeof(T*)), &copy, sizeof(T*));
+			}
+		}
+		template <class T>
+		void del(ent_type e) {
+			push(e).apply = [](ent_type e, void*) { World::delComponent<T>(e); };
+		}
+		void destroy(ent_type e) {
+			push(e).destroy = true;
+		}
+
+		void merge(CommandBuffer& other) {
+			const size_type base = align(_bytes);
+			reserve(base + other._bytes);
+			if (other._bytes > 0)
+				memcpy(_data + base, other._data, other._bytes);
+			_bytes = base + other._bytes;
+			for (index_type i = 0; i < other._cmds.size(); ++i) {
+				Command c = other._cmds[i];
+				if (c.e.id < 0)
+					c.e.id -= _created;
+				c.offset += base;
+				_cmds.push(c);
+			}
+			_created += other._created;
+			other.reset();
+		}
+		void playback() {
+			Command* cmds = &_cmds[0];
+			const size_type n = _cmds.size();
+			for (index_type i = 0; i < n; ++i)
+				if (cmds[i].create)
+					_resolved.push(World::createEntity());
+			for (index_type i = 0; i < n; ++i)
+				if (cmds[i].e.id < 0)
+					cmds[i].e = _resolved[-cmds[i].e.id - 1];
+
+			// commands on one entity keep their recorded order
+			std::stable_sort(cmds, cmds + n, [](const Command& a, const Command& b) {
+				return a.e.id < b.e.id;
+			});
+			// commands on an entity destroyed since they were recorded are dropped
+			for (index_type i = 0; i < n; ++i) {
+				if (!World::valid(cmds[i].e)) {
+					if (cmds[i].discard != nullptr)
+						cmds[i].discard(_data + cmds[i].offset);
+					continue;
+				}
+				if (cmds[i].apply != nullptr)
+					cmds[i].apply(cmds[i].e, _data + cmds[i].offset);
+				if (cmds[i].destroy && (_destroyed.size() == 0 || _destroyed[_destroyed.size()-1].id != cmds[i].e.id))
+					_destroyed.push(cmds[i].e);
+			}
+			// destroys go last and in one batch
+			if (_destroyed.size() > 0)
+				World::destroyEntities({&_destroyed[0], _destroyed.size()});
+			reset();
+		}
+		void clear() {
+			for (index_type i = 0; i < _cmds.size(); ++i)
+				if (_cmds[i].discard != nullptr)
+					_cmds[i].discard(_data + _cmds[i].offset);
+			reset();
+		}
+
+		size_type size() const { return _cmds.size(); }
+		bool empty() const { return _cmds.size() == 0; }
+
+		~CommandBuffer() {
+			clear();
+			Params.Deallocate(_data);
+		}
+	private:
+		struct Command {
+			ent_type	e;
+			bool		create = false;
+			bool		destroy = false;
+			void		(*apply)(ent_type, void*) = nullptr;
+			void		(*discard)(void*) = nullptr;
+			size_type	offset = 0;
+		};
+
+		Command& push(ent_type e) {
+			Command c;
+			c.e = e;
+			_cmds.push(c);
+			return _cmds[_cmds.size()-1];
+		}
+		static size_type align(size_type bytes) {
+			constexpr size_type A = alignof(std::max_align_t);
+			return (bytes + A - 1) / A * A;
+		}
+		void* payload(Command& c, size_type bytes) {
+			c.offset = align(_bytes);
+			reserve(c.offset + bytes);
+			_bytes = c.offset + bytes;
+			return _data + c.offset;
+		}
+		void reserve(size_type bytes) {
+			if (bytes > _capacity) {
+				_capacity = std::max(bytes, _capacity*2);
+				_data = static_cast<unsigned char*>(Params.Reallocate(_data, _capacity));
+			}
+		}
+		void reset() {
+			_cmds.clear();
+			_resolved.clear();
+			_destroyed.clear();
+			_bytes = 0;
+			_created = 0;
+		}
+
+		DynamicBag<Command,64>		_cmds;
+		DynamicBag<ent_type,16>		_resolved;
+		DynamicBag<ent_type,16>		_destroyed;
+		unsigned char*				_data = nullptr;
+		size_type					_bytes = 0;
+		size_type					_capacity = 0;
+		size_type					_created = 0;
+	};
+
+	// parallelFor splits [first,last) into grain-sized chunks, deals each thread a
+	// contiguous run of them and lets idle threads steal from the back of others
+	class ThreadPool : NoCopy
+	{
+	public:
+		static constexpr size_type MinGrain = 1024;
+		static constexpr size_type ChunksPerThread = 8;
+
+		explicit ThreadPool(size_type workers = defaultWorkers())
+			: _workers(workers), _queues(new Queue[workers+1]) {
+			for (index_type i = 0; i < workers; ++i)
+				_threads.push(new std::thread(&ThreadPool::work, this, i));
+		}
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+			}
+			_wake.notify_all();
+			for (index_type i = 0; i < _threads.size(); ++i) {
+				_threads[i]->join();
+				delete _threads[i];
+			}
+			delete[] _queues;
+		}
+		static ThreadPool& global() {
+			static ThreadPool pool;
+			return pool;
+		}
+
+		// f(begin, end) is called once per chunk; nested calls run serially
+		template <class F>
+		void parallelFor(index_type first, index_type last, size_type grain, F&& f) {
+			if (last <= first)
+				return;
+			grain = std::max(grain, 1);
+			const size_type chunks = (last - first + grain - 1) / grain;
+			if (_workers == 0 || chunks == 1 || inside() != nullptr) {
+				for (index_type b = first; b < last; b += grain)
+					f(b, std::min(b + grain, last));
+				return;
+			}
+			std::lock_guard<std::mutex> job(_job);
+			inside() = this;
+			_registry = &Registry::current();
+			_fn = &f;
+			_invoke = [](void* fn, index_type b, index_type e) { (*static_cast<std::remove_reference_t<F>*>(fn))(b, e); };
+			_first = first;
+			_last = last;
+			_grain = grain;
+			_remaining = chunks;
+			const size_type threads = _workers + 1;
+			for (index_type q = 0; q < threads; ++q) {
+				std::lock_guard<std::mutex> lock(_queues[q].lock);
+				_queues[q].begin = static_cast<index_type>(std::int64_t{chunks} * q / threads);
+				_queues[q].end = static_cast<index_type>(std::int64_t{chunks} * (q+1) / threads);
+			}
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				++_generation;
+			}
+			_wake.notify_all();
+			participate(_workers);
+			while (_remaining.load(std::memory_order_acquire) != 0)
+				std::this_thread::yield();
+			inside() = nullptr;
+		}
+
+		size_type workers() const { return _workers; }
+		size_type threads() const { return _workers + 1; }
+		static size_type defaultWorkers() {
+			const size_type hw = std::thread::hardware_concurrency();
+			return hw > 1 ? hw - 1 : 0;
+		}
+		// enough chunks per thread to balance, rounded to whole cache lines of ids
+		static size_type grain(size_type n, size_type threads) {
+			const size_type g = std::max(MinGrain, n / (threads * ChunksPerThread));
+			return (g + WordBits - 1) / WordBits * WordBits;
+		}
+	private:
+		struct alignas(64) Queue {
+			std::mutex	lock;
+			index_type	begin = 0;
+			index_type	end = 0;
+		};
+
+		static ThreadPool*& inside() {
+			static thread_local ThreadPool* pool = nullptr;
+			return pool;
+		}
+		bool pop(index_type q, index_type& chunk) {
+			std::lock_guard<std::mutex> lock(_queues[q].lock);
+			if (_queues[q].begin == _queues[q].end)
+				return false;
+			chunk = _queues[q].begin++;
+			return true;
+		}
+		bool steal(index_type self, index_type& chunk) {
+			for (index_type i = 1; i <= _workers; ++i) {
+				Queue& victim = _queues[(self + i) % (_workers + 1)];
+				std::lock_guard<std::mutex> lock(victim.lock);
+				if (victim.begin != victim.end) {
+					chunk = --victim.end;
+					return true;
+				}
+			}
+			return false;
+		}
+		void participate(index_type self) {
+			index_type chunk;
+			while (pop(self, chunk) || steal(self, chunk)) {
+				// the job is read only after a chunk was claimed, so a late worker never
+				// runs the next job's chunks under the previous job's registry
+				const index_type b = _first + chunk*_grain;
+				Registry& registry = *_registry;
+				if (&registry == &Registry::current())
+					_invoke(_fn, b, std::min(b + _grain, _last));
+				else {
+					Registry::Scope scope(registry);
+					_invoke(_fn, b, std::min(b + _grain, _last));
+				}
+				_remaining.fetch_sub(1, std::memory_order_release);
+			}
+		}
+		void work(index_type self) {
+			inside() = this;
+			std::size_t seen = 0;
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (true) {
+				_wake.wait(lock, [&] { return _stop || _generation != seen; });
+				if (_stop)
+					return;
+				seen = _generation;
+				lock.unlock();
+				participate(self);
+				lock.lock();
+			}
+		}
+
+		const size_type				_workers;
+		Queue*						_queues;
+		DynamicBag<std::thread*,8>	_threads;
+
+		std::mutex					_job;
+		Registry*					_registry = nullptr;
+		void*						_fn = nullptr;
+		void						(*_invoke)(void*, index_type, index_type) = nullptr;
+		index_type					_first = 0;
+		index_type					_last = 0;
+		size_type					_grain = 0;
+		std::atomic<size_type>		_remaining{0};
+
+		std::mutex					_mutex;
+		std::condition_variable		_wake;
+		std::size_t					_generation = 0;
+		bool						_stop = false;
+	};
+
+	template <class ...Ts, class ...Xs, class ...Os>
+	class View<TypeList<Ts...>, TypeList<Xs...>, TypeList<Os...>>
+	{
+		using Dense = Bag<ent_type,Params.InitialPackedSize>;
+		static constexpr bool Bitsets = Params.ComponentBitsets && sizeof...(Ts) > 0;
+	public:
+		class iterator
+		{
+		public:
+			ent_type operator*() const {
+				if (_view->_dense == nullptr && Bitsets)
+					return World::entity(id_type(_pos*WordBits + __builtin_ctzll(_word)));
+				return _view->candidate(_pos);
+			}
+			iterator& operator++() {
+				advance();
+				skip();
+				return *this;
+			}
+			bool operator!=(const iterator& o) const { return _pos != o._pos; }
+		private:
+			friend View;
+			iterator(const View* v, index_type pos) : _view(v), _pos(pos) {
+				if (_view->_dense == nullptr && Bitsets && _pos != _view->last())
+					_word = _view->word(_pos);
+				skip();
+			}
+			void advance() {
+				if (_view->_dense != nullptr || !Bitsets)
+					_pos += _view->step();
+				else if ((_word &= _word-1) == 0)
+					nextWord();
+			}
+			void nextWord() {
+				while (++_pos != _view->last())
+					if ((_word = _view->word(_pos)) != 0)
+						return;
+			}
+			void skip() {
+				if (_view->_dense == nullptr && Bitsets && _word == 0 && _pos != _view->last())
+					nextWord();
+				while (_pos != _view->last() && !_view->contains(**this))
+					advance();
+			}
+
+			const View*	_view;
+			index_type	_pos;
+			word_type	_word = 0;
+		};
+
+		View() {
+			(_mask.set(Component<Ts>::Bit), ...);
+			(_exclude.set(Component<Xs>::Bit), ...);
+			(consider<Ts>(), ...);
+		}
+
+		template <class ...Ys>
+		View<TypeList<Ts...>, TypeList<Xs...,Ys...>, TypeList<Os...>> exclude() const {
+			View<TypeList<Ts...>, TypeList<Xs...,Ys...>, TypeList<Os...>> v;
+			v.onlyChanged(_changed);
+			return v;
+		}
+		template <class ...Ys>
+		View<TypeList<Ts...>, TypeList<Xs...>, TypeList<Os...,Ys...>> optional() const {
+			View<TypeList<Ts...>, TypeList<Xs...>, TypeList<Os...,Ys...>> v;
+			v.onlyChanged(_changed);
+			return v;
+		}
+		// restrict to entities whose T changed this frame
+		template <class T>
+		View changed() const {
+			static_assert(Params.ChangeTracking, "Enable Params.ChangeTracking");
+			View v = *this;
+			v.onlyChanged(Component<T>::Index);
+			return v;
+		}
+
+		bool contains(ent_type e) const {
+			const Mask& m = World::mask(e);
+			if (!m.test(_mask) || (m.test(Component<Xs>::Bit) || ...))
+				return false;
+			// the changed list keeps the handles of destroyed entities until step()
+			if constexpr (Params.ChangeTracking)
+				return _changed < 0 || (World::valid(e) && World::changed(_changed, e));
+			return true;
+		}
+		size_type candidates() const {
+			if (_dense != nullptr)
+				return _dense->size();
+			if constexpr (Bitsets)
+				return words() * WordBits;
+			return World::maxId().id + 1;
+		}
+
+		iterator begin() const { return {this, first()}; }
+		iterator end() const { return {this, last()}; }
+
+		template <class F>
+		void each(F&& f) const {
+			if (_dense == nullptr) {
+				if constexpr (Bitsets)
+					eachBit(f, 0, words());
+				else
+					eachScan(f, 0, World::maxId().id + 1);
+				return;
+			}
+			for (index_type i = first(); i != last(); i += step()) {
+				const ent_type e = candidate(i);
+				if (contains(e))
+					visit(f, e);
+			}
+		}
+
+		// f must not add or remove components or entities
+		template <class F>
+		void parallelEach(F&& f, ThreadPool& pool = ThreadPool::global()) const {
+			const size_type g = ThreadPool::grain(candidates(), pool.threads());
+			if (_dense != nullptr) {
+				pool.parallelFor(0, _dense->size(), g, [&](index_type b, index_type e) {
+					for (index_type i = e-1; i >= b; --i)
+						if (contains(candidate(i)))
+							visit(f, candidate(i));
+				});
+			} else if constexpr (Bitsets) {
+				pool.parallelFor(0, words(), g / WordBits, [&](index_type b, index_type e) {
+					eachBit(f, b, e);
+				});
+			} else {
+				pool.parallelFor(0, World::maxId().id + 1, g, [&](index_type b, index_type e) {
+					eachScan(f, b, e);
+				});
+			}
+		}
+
+		template <class T>
+		static Span<T> raw() {
+			static_assert(IsPacked<typename Storage<T>::type>::value, "raw() requires a PackedStorage component");
+			return PackedStorage<T>::components();
+		}
+	private:
+		template <class, class, class> friend class View;
+
+		void onlyChanged(index_type comp) {
+			if constexpr (Params.ChangeTracking) {
+				if (comp >= 0) {
+					_changed = comp;
+					_dense = &World::s()._changed[comp];
+				}
+			}
+		}
+		template <class T>
+		void consider() {
+			if constexpr (IsPacked<typename Storage<T>::type>::value) {
+				const Dense& d = PackedStorage<T>::s()._compToEnt;
+				if (_dense == nullptr || d.size() < _dense->size())
+					_dense = &d;
+			}
+		}
+		template <class O>
+		static O* getOptional(ent_type e) {
+			return World::mask(e).test(Component<O>::Bit) ? &World::getComponent<O>(e) : nullptr;
+		}
+		template <class F>
+		static void visit(F& f, ent_type e) {
+			f(e, World::getComponent<Ts>(e)..., getOptional<Os>(e)...);
+		}
+
+		static size_type words() {
+			if constexpr (Bitsets)
+				return std::min({World::bits(Component<Ts>::Index).size...});
+			return 0;
+		}
+		static word_type word(index_type w) {
+			if constexpr (Bitsets)
+				return (World::bits(Component<Ts>::Index)[w] & ...)
+					& ~(World::bitWord(Component<Xs>::Index, w) | ... | word_type{0});
+			return 0;
+		}
+		template <class F>
+		void eachWord(F& f, index_type w, word_type m) const {
+			while (m != 0) {
+				const ent_type e = World::entity(id_type(w*WordBits + __builtin_ctzll(m)));
+				m &= m-1;
+				if (contains(e))
+					visit(f, e);
+			}
+		}
+		template <class F>
+		void eachBit(F& f, index_type w, index_type end) const {
+#if defined(__AVX2__)
+			for (; w + 4 <= end; w += 4) {
+				const __m256i all = _mm256_set1_epi64x(-1);
+				const __m256i v = _mm256_andnot_si256(
+					(_mm256_set_epi64x(World::bitWord(Component<Xs>::Index, w+3),
+						World::bitWord(Component<Xs>::Index, w+2),
+						World::bitWord(Component<Xs>::Index, w+1),
+						World::bitWord(Component<Xs>::Index, w)) | ... | _mm256_setzero_si256()),
+					(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+						World::bits(Component<Ts>::Index).data + w)) & ... & all));
+				if (_mm256_testz_si256(v, v))
+					continue;
+				alignas(32) word_type block[4];
+				_mm256_store_si256(reinterpret_cast<__m256i*>(block), v);
+				for (index_type i = 0; i < 4; ++i)
+					eachWord(f, w+i, block[i]);
+			}
+#endif
+			for (; w < end; ++w)
+				eachWord(f, w, word(w));
+		}
+
+		template <class F>
+		void eachScan(F& f, id_type first, id_type end) const {
+			constexpr size_type Block = 1024;
+			ent_type block[Block];
+			for (; first < end; first += Block) {
+				const size_type n = World::scan(first,
+					std::min(Block, end - first), _mask, _exclude, block);
+				for (index_type i = 0; i < n; ++i)
+					if (contains(block[i]))
+						visit(f, block[i]);
+			}
+		}
+
+		// packed candidates are walked backwards so the current entity may be removed
+		index_type first() const { return _dense != nullptr ? _dense->size()-1 : 0; }
+		index_type last() const {
+			if (_dense != nullptr)
+				return -1;
+			if constexpr (Bitsets)
+				return words();
+			return World::maxId().id + 1;
+		}
+		index_type step() const { return _dense != nullptr ? -1 : 1; }
+		ent_type candidate(index_type i) const {
+			return _dense != nullptr ? (*_dense)[i] : World::entity(id_type(i));
+		}
+
+		Mask			_mask;
+		Mask			_exclude;
+		const Dense*	_dense = nullptr;
+		index_type		_changed = -1;
+	};
+
+	// members of every owned storage sit at [0,size()) in the same order,
+	// so joined iteration walks parallel arrays
+	template <class T, class ...Ts>
+	class Group
+	{
+		static_assert((IsPacked<typename Storage<T>::type>::value && ... &&
+			IsPacked<typename Storage<Ts>::type>::value), "Owning groups require PackedStorage components");
+	public:
+		// claimed once per registry
+		Group() {
+			if (PackedStorage<T>::s()._owner.added != added)
+				claim();
+		}
+
+		size_type size() const { return count(); }
+		Span<const ent_type> entities() const { return {PackedStorage<T>::entities().data, count()}; }
+		template <class C>
+		Span<C> components() const { return {PackedStorage<C>::components().data, count()}; }
+
+		// f may remove members, but must not add owned components
+		template <class F>
+		void each(F&& f) const {
+			const ent_type* ents = PackedStorage<T>::entities().data;
+			T* first = PackedStorage<T>::components().data;
+			std::tuple<Ts*...> cols{PackedStorage<Ts>::components().data...};
+			for (index_type i = count()-1; i >= 0; --i)
+				f(ents[i], first[i], std::get<Ts*>(cols)[i]...);
+		}
+	private:
+		static void claim() {
+			if (!(PackedStorage<T>::own({added, removed, members, swap, rebuild}) && ... &&
+				PackedStorage<Ts>::own({added, removed, members, swap, rebuild})))
+				std::abort(); // a storage is already owned by another group
+			rebuild();
+		}
+		static void rebuild() {
+			count() = 0;
+			for (index_type i = 0; i < PackedStorage<T>::size(); ++i)
+				added(PackedStorage<T>::entity(i));
+		}
+		static void added(ent_type e) {
+			if (!(PackedStorage<T>::has(e) && ... && PackedStorage<Ts>::has(e)))
+				return;
+			if (PackedStorage<T>::index(e) < count())
+				return;
+			PackedStorage<T>::swap(PackedStorage<T>::index(e), count());
+			(PackedStorage<Ts>::swap(PackedStorage<Ts>::index(e), count()), ...);
+			++count();
+		}
+		static void removed(ent_type e) {
+			const index_type i = PackedStorage<T>::index(e);
+			if (i < 0 || i >= count())
+				return;
+			--count();
+			PackedStorage<T>::swap(i, count());
+			(PackedStorage<Ts>::swap(PackedStorage<Ts>::index(e), count()), ...);
+		}
+		static size_type members() { return count(); }
+		static void swap(index_type i, index_type j) {
+			PackedStorage<T>::swap(i, j);
+			(PackedStorage<Ts>::swap(i, j), ...);
+		}
+		static size_type& count() { return PackedStorage<T>::s()._owned; }
+	};
+
+	template <class Required, class Excluded = TypeList<>>
+	class ReactiveSystem;
+
+	// keeps the entities matching Required and not Excluded, updated from the
+	// structural change records instead of rescanning every frame
+	template <class ...Ts, class ...Xs>
+	class ReactiveSystem<TypeList<Ts...>, TypeList<Xs...>> : NoCopy
+	{
+		static_assert(Params.AggregateUpdates, "ReactiveSystem requires Params.AggregateUpdates");
+	public:
+		ReactiveSystem() {
+			(_mask.set(Component<Ts>::Bit), ...);
+			(_exclude.set(Component<Xs>::Bit), ...);
+			rescan(this);
+			World::registerReactive(sync, rescan, this);
+		}
+		~ReactiveSystem() {
+			Registry::Scope scope(_registry);
+			World::unregisterReactive(this);
+		}
+
+		void sync() {
+			for (; _cursor < World::sizeAdded(); ++_cursor) {
+				const AddedMask& am = World::getAdded(_cursor);
+				const bool was = matches(am.prev), is = matches(am.next);
+				if (was && !is)
+					erase(am.e);
+				else if (!was && is)
+					insert(am.e);
+			}
+		}
+		Span<const ent_type> entities() {
+			sync();
+			return {&_entities[0], _entities.size()};
+		}
+		bool contains(ent_type e) {
+			sync();
+			return _index.get(e.id) >= 0;
+		}
+		size_type size() {
+			sync();
+			return _entities.size();
+		}
+
+		// changes made inside f are applied at the next sync
+		template <class F>
+		void each(F&& f) {
+			sync();
+			for (index_type i = _entities.size()-1; i >= 0; --i) {
+				const ent_type e = _entities[i];
+				f(e, World::getComponent<Ts>(e)...);
+			}
+		}
+	private:
+		static void sync(void* self) {
+			static_cast<ReactiveSystem*>(self)->sync();
+			static_cast<ReactiveSystem*>(self)->_cursor = 0;
+		}
+		static void rescan(void* self) {
+			ReactiveSystem& s = *static_cast<ReactiveSystem*>(self);
+			s._entities.clear();
+			s._index.clear();
+			for (ent_type e{0}; e.id <= World::maxId().id; ++e.id)
+				if (s.matches(World::mask(e)))
+					s.insert(World::entity(e.id));
+			s._cursor = World::sizeAdded();
+		}
+		bool matches(const Mask& m) const {
+			return m.test(_mask) && !m.any(_exclude);
+		}
+		void insert(ent_type e) {
+			_index[e.id] = _entities.size();
+			_entities.push(e);
+		}
+		void erase(ent_type e) {
+			const index_type i = _index[e.id];
+			const ent_type last = _entities.pop();
+			_index[e.id] = -1;
+			if (last.id == e.id)
+				return;
+			_entities[i] = last;
+			_index[last.id] = i;
+		}
+
+		Mask						_mask;
+		Mask						_exclude;
+		DynamicBag<ent_type,64>		_entities;
+		PagedBag<slot_type,-1>		_index;
+		index_type					_cursor = 0;
+		Registry&					_registry = Registry::current();
+	};
+
+	template <class ...Ts, class F>
+	void parallelEach(F&& f) {
+		World::view<Ts...>().parallelEach(std::forward<F>(f));
+	}
+
 	class MaskBuilder
 	{
 	public:
 		template <class T>
-		MaskBuilder& set() {
+		constexpr MaskBuilder& set() {
 			m.set(Component<T>::Bit);
 			return *this;
 		}
-		Mask build() const { return m; }
+		constexpr Mask build() const { return m; }
 	private:
 		Mask m;
 	};
+
+	template <class ...> struct Reads {};
+	template <class ...> struct Writes {};
+
+	// systems added with add() may run concurrently with any system whose
+	// declared components they do not write (or read what it writes);
+	// exclusive() systems may change structure and run alone, on the caller and
+	// outside the pool, so a wide system there can fan out with parallelEach.
+	// The rest run on the pool's threads, parallelEach inside them runs serially
+	class Scheduler : NoCopy
+	{
+	public:
+		explicit Scheduler(ThreadPool& pool = ThreadPool::global()) : _pool(pool) {}
+		~Scheduler() {
+			for (index_type i = 0; i < _systems.size(); ++i)
+				_systems[i].destroy(_systems[i].fn);
+		}
+
+		template <class R = Reads<>, class W = Writes<>, class F>
+		index_type add(F&& f) {
+			return push(std::forward<F>(f), mask(R{}), mask(W{}), false);
+		}
+		template <class F>
+		index_type exclusive(F&& f) {
+			return push(std::forward<F>(f), Mask{}, Mask{}, true);
+		}
+
+		void build() {
+			const size_type n = _systems.size();
+			_next.clear();
+			_first.clear();
+			_indegree.clear();
+			for (index_type i = 0; i < n; ++i)
+				_indegree.push(0);
+			for (index_type i = 0; i < n; ++i) {
+				_first.push(_next.size());
+				for (index_type j = i+1; j < n; ++j) {
+					if (conflict(_systems[i], _systems[j])) {
+						_next.push(j);
+						++_indegree[j];
+					}
+				}
+			}
+			_first.push(_next.size());
+			_built = true;
+		}
+		void run() {
+			if (!_built)
+				build();
+			std::unique_lock<std::mutex> lock(_mutex);
+			_pending.clear();
+			_ready.clear();
+			_readyMain.clear();
+			_head = _headMain = 0;
+			_remaining = _systems.size();
+			for (index_type i = 0; i < _systems.size(); ++i) {
+				_pending.push(_indegree[i]);
+				if (_indegree[i] == 0)
+					schedule(i);
+			}
+			// an exclusive system conflicts with every other, so it is ready only
+			// once everything before it finished; the others run in stages between
+			while (_remaining > 0) {
+				if (_headMain < _readyMain.size())
+					execute(_readyMain[_headMain++], lock);
+				else {
+					lock.unlock();
+					_pool.parallelFor(0, _pool.threads(), 1, [this](index_type, index_type) { drain(); });
+					lock.lock();
+				}
+			}
+		}
+
+		size_type size() const { return _systems.size(); }
+		size_type workers() const { return _pool.threads() - 1; }
+	private:
+		struct System {
+			Mask	reads;
+			Mask	writes;
+			bool	exclusive;
+			void	(*invoke)(void*);
+			void	(*destroy)(void*);
+			void*	fn;
+		};
+
+		template <template <class...> class L, class ...Ts>
+		static Mask mask(L<Ts...>) {
+			Mask m;
+			(m.set(Component<Ts>::Bit), ...);
+			return m;
+		}
+		static bool conflict(const System& a, const System& b) {
+			return a.exclusive || b.exclusive ||
+				a.writes.any(b.reads) || a.writes.any(b.writes) || b.writes.any(a.reads);
+		}
+		template <class F>
+		index_type push(F&& f, const Mask& reads, const Mask& writes, bool exclusive) {
+			using Fn = std::decay_t<F>;
+			System s{reads, writes, exclusive,
+				[](void* fn) { (*static_cast<Fn*>(fn))(); },
+				[](void* fn) { delete static_cast<Fn*>(fn); },
+				new Fn(std::forward<F>(f))};
+			_systems.push(s);
+			_built = false;
+			return _systems.size()-1;
+		}
+
+		void schedule(index_type i) {
+			if (_systems[i].exclusive)
+				_readyMain.push(i);
+			else
+				_ready.push(i);
+		}
+		void execute(index_type i, std::unique_lock<std::mutex>& lock) {
+			lock.unlock();
+			_systems[i].invoke(_systems[i].fn);
+			lock.lock();
+			bool wake = false;
+			for (index_type k = _first[i]; k < _first[i+1]; ++k) {
+				const index_type j = _next[k];
+				if (--_pending[j] == 0) {
+					schedule(j);
+					wake = true;
+				}
+			}
+			--_remaining;
+			if (wake)
+				_wake.notify_all();
+		}
+		// each pool thread runs ready systems until the stage has none left
+		void drain() {
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (true) {
+				if (_head < _ready.size()) {
+					++_running;
+					execute(_ready[_head++], lock);
+					if (--_running == 0)
+						_wake.notify_all();
+				}
+				else if (_running == 0)
+					return;
+				else
+					_wake.wait(lock);
+			}
+		}
+
+		DynamicBag<System,16>		_systems;
+		DynamicBag<index_type,16>	_indegree;
+		DynamicBag<index_type,16>	_first;
+		DynamicBag<index_type,64>	_next;
+		bool						_built = false;
+
+		DynamicBag<index_type,16>	_pending;
+		DynamicBag<index_type,16>	_ready;
+		DynamicBag<index_type,16>	_readyMain;
+		index_type					_head = 0;
+		index_type					_headMain = 0;
+		size_type					_remaining = 0;
+		size_type					_running = 0;
+
+		ThreadPool&					_pool;
+		std::mutex					_mutex;
+		std::condition_variable		_wake;
+	};
 }
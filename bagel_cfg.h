@@ -1,7 +1,8 @@
 #pragma once
 
 constexpr Bagel Params{
-	.DynamicResize = false
+	.DynamicResize = true,
+	.VirtualMemory = true
 };
 
 //BAGEL_STORAGE(Position,PackedStorage)
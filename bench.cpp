@@ -0,0 +1,424 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bagel.h"
+using namespace std;
+using namespace bagel;
+
+namespace
+{
+	struct SparsePos { float x, y; };
+	struct SparseVel { float x, y; };
+	struct PackedPos { float x, y; };
+	struct PackedVel { float x, y; };
+	struct ArchPos { float x, y; };
+	struct ArchVel { float x, y; };
+	struct ViewPos { float x, y; };
+	struct ViewVel { float x, y; };
+	struct BitTag {};
+	struct BitInput { bool fire; };
+	struct SpawnPos { float x, y; };
+	struct SpawnVel { float x, y; };
+	struct SpawnHp { int hp; };
+	struct SpawnScore { int value; };
+	struct SortPos { float x, y; };
+	struct SnapPos { float x, y; };
+	struct SnapHp { int hp; };
+	struct GamePos { float x, y; };
+	struct GameVel { float x, y; };
+	struct SchedPos { float x, y; };
+	struct SchedVel { float x, y; };
+	struct SchedHp { int hp; };
+	struct RareSparse { int v; };
+	struct RarePacked { int v; };
+	struct RareHash { int v; };
+}
+template <> struct bagel::Storage<PackedPos> { using type = PackedStorage<PackedPos>; };
+template <> struct bagel::Storage<PackedVel> { using type = PackedStorage<PackedVel>; };
+template <> struct bagel::Storage<ArchPos> { using type = ArchetypeStorage<ArchPos>; };
+template <> struct bagel::Storage<ArchVel> { using type = ArchetypeStorage<ArchVel>; };
+template <> struct bagel::Storage<ViewPos> { using type = PackedStorage<ViewPos>; };
+template <> struct bagel::Storage<ViewVel> { using type = PackedStorage<ViewVel>; };
+template <> struct bagel::Storage<SpawnPos> { using type = PackedStorage<SpawnPos>; };
+template <> struct bagel::Storage<SpawnVel> { using type = PackedStorage<SpawnVel>; };
+template <> struct bagel::Storage<GamePos> { using type = PackedStorage<GamePos>; };
+template <> struct bagel::Storage<GameVel> { using type = PackedStorage<GameVel>; };
+template <> struct bagel::Storage<SchedPos> { using type = PackedStorage<SchedPos>; };
+template <> struct bagel::Storage<SchedVel> { using type = PackedStorage<SchedVel>; };
+template <> struct bagel::Storage<SchedHp> { using type = PackedStorage<SchedHp>; };
+template <> struct bagel::Storage<SortPos> { using type = PackedStorage<SortPos>; };
+template <> struct bagel::Storage<SnapHp> { using type = PackedStorage<SnapHp>; };
+template <> struct bagel::Storage<RarePacked> { using type = PackedStorage<RarePacked>; };
+template <> struct bagel::Storage<RareHash> { using type = HashStorage<RareHash>; };
+
+namespace
+{
+	constexpr int Entities = 1000000;
+	constexpr int Reps = 10;
+
+	template <class F, class R = void (*)()>
+	double measure(F&& f, R&& reset = [] {})
+	{
+		double best = 1e30;
+		for (int i = 0; i < Reps; ++i) {
+			auto start = chrono::steady_clock::now();
+			f();
+			chrono::duration<double,milli> d = chrono::steady_clock::now() - start;
+			best = min(best, d.count());
+			reset();
+		}
+		return best;
+	}
+	void report(const char* name, double ms)
+	{
+		cout << "  " << name << ": " << ms << " ms\n";
+	}
+
+	template <class P, class V>
+	void scanMovement()
+	{
+		for (id_type id = 0; id <= World::maxId().id; ++id) {
+			ent_type ent{id};
+			if (!World::mask(ent).test(Component<P>::Bit) ||
+				!World::mask(ent).test(Component<V>::Bit))
+				continue;
+			P& pos = World::getComponent<P>(ent);
+			const V& vel = World::getComponent<V>(ent);
+			pos.x += vel.x;
+			pos.y += vel.y;
+		}
+	}
+
+	void benchArchetype()
+	{
+		cout << "MovementSystem, " << Entities << " entities\n";
+		for (int i = 0; i < Entities; ++i) {
+			Entity e = Entity::create();
+			e.addAll(SparsePos{0,0}, SparseVel{1,1},
+				PackedPos{0,0}, PackedVel{1,1},
+				ArchPos{0,0}, ArchVel{1,1});
+		}
+		World::step();
+
+		report("sparse", measure(scanMovement<SparsePos,SparseVel>));
+		report("packed", measure(scanMovement<PackedPos,PackedVel>));
+		report("archetype", measure([] {
+			Archetypes::eachChunk<ArchPos,ArchVel>(
+				[](size_type n, const ent_type*, ArchPos* pos, const ArchVel* vel) {
+					for (index_type i = 0; i < n; ++i) {
+						pos[i].x += vel[i].x;
+						pos[i].y += vel[i].y;
+					}
+				});
+		}));
+	}
+
+	void benchView()
+	{
+		constexpr int Every = 100;
+		cout << "MovementSystem, " << Entities/Every << " of " << Entities << " entities match\n";
+		for (int i = 0; i < Entities; ++i) {
+			Entity e = Entity::create();
+			if (i % Every == 0)
+				e.addAll(ViewPos{0,0}, ViewVel{1,1});
+		}
+		World::step();
+
+		report("scan", measure(scanMovement<ViewPos,ViewVel>));
+		report("view", measure([] {
+			World::view<ViewPos,ViewVel>().each([](ent_type, ViewPos& pos, const ViewVel& vel) {
+				pos.x += vel.x;
+				pos.y += vel.y;
+			});
+		}));
+	}
+
+	void benchBitset()
+	{
+		constexpr int Every = 10000;
+		cout << "BitTag & BitInput & SparsePos, " << Entities/Every << " of " << Entities << " entities match\n";
+		for (int i = 0; i < Entities; ++i) {
+			Entity e = Entity::create();
+			e.add(SparsePos{0,0});
+			if (i % Every == 0)
+				e.addAll(BitTag{}, BitInput{true});
+		}
+		World::step();
+
+		static int fired;
+		report("scan", measure([] {
+			for (id_type id = 0; id <= World::maxId().id; ++id) {
+				ent_type ent{id};
+				if (!World::mask(ent).test(Component<BitTag>::Bit) ||
+					!World::mask(ent).test(Component<BitInput>::Bit) ||
+					!World::mask(ent).test(Component<SparsePos>::Bit))
+					continue;
+				fired += World::getComponent<BitInput>(ent).fire;
+			}
+		}));
+		report("bitsets", measure([] {
+			World::view<BitTag,BitInput,SparsePos>().each(
+				[](ent_type, BitTag&, const BitInput& in, SparsePos&) { fired += in.fire; });
+		}));
+	}
+
+	void benchSpawn()
+	{
+		constexpr int Spawned = 100000;
+		cout << "Spawn " << Spawned << " entities with 4 components\n";
+		static ent_type ents[Spawned];
+		auto destroyAll = [] {
+			for (ent_type e : ents)
+				World::destroyEntity(e);
+			World::step();
+		};
+		report("addAll", measure([] {
+			for (ent_type& e : ents) {
+				e = World::createEntity();
+				World::addComponents(e, SpawnPos{0,0}, SpawnVel{1,1}, SpawnHp{3}, SpawnScore{10});
+			}
+		}, destroyAll));
+		report("createEntities", measure([] {
+			World::createEntities({ents, Spawned}, SpawnPos{0,0}, SpawnVel{1,1}, SpawnHp{3}, SpawnScore{10});
+		}, destroyAll));
+
+		auto createAll = [] {
+			World::createEntities({ents, Spawned}, SpawnPos{0,0}, SpawnVel{1,1}, SpawnHp{3}, SpawnScore{10});
+		};
+		createAll();
+		report("destroyEntity", measure([] {
+			for (ent_type e : ents)
+				World::destroyEntity(e);
+		}, createAll));
+		World::step();
+		report("destroyEntities", measure([] {
+			World::destroyEntities({ents, Spawned});
+		}, createAll));
+		World::destroyEntities({ents, Spawned});
+		World::step();
+	}
+
+	void benchParallel()
+	{
+		cout << "parallelEach MovementSystem, " << Entities << " entities, "
+			<< thread::hardware_concurrency() << " hardware threads\n";
+		for (int i = 0; i < Entities; ++i)
+			Entity::create().addAll(ViewPos{0,0}, ViewVel{1,1});
+		World::step();
+
+		report("each", measure([] {
+			World::view<ViewPos,ViewVel>().each([](ent_type, ViewPos& pos, const ViewVel& vel) {
+				pos.x += vel.x;
+				pos.y += vel.y;
+			});
+		}));
+		for (int threads : {1, 2, 4, 8, 16}) {
+			static ThreadPool* pool;
+			ThreadPool p(threads - 1);
+			pool = &p;
+			const string name = to_string(threads) + " threads";
+			report(name.c_str(), measure([] {
+				World::view<ViewPos,ViewVel>().parallelEach([](ent_type, ViewPos& pos, const ViewVel& vel) {
+					pos.x += vel.x;
+					pos.y += vel.y;
+				}, *pool);
+			}));
+		}
+
+		// the rows above call parallelEach directly on a million entities; the game
+		// runs MovementSystem as an exclusive scheduled system on a few dozen,
+		// below one chunk, so there it stays serial whatever the thread count
+		constexpr int GameEntities = 64;
+		constexpr int Frames = 1000;
+		for (int i = 0; i < GameEntities; ++i)
+			Entity::create().addAll(GamePos{0,0}, GameVel{1,1});
+		World::step();
+		for (int threads : {1, 4}) {
+			static ThreadPool* pool;
+			ThreadPool p(threads - 1);
+			pool = &p;
+			Scheduler scheduler(p);
+			scheduler.exclusive([] {
+				World::view<GamePos,GameVel>().parallelEach([](ent_type, GamePos& pos, const GameVel& vel) {
+					pos.x += vel.x;
+					pos.y += vel.y;
+				}, *pool);
+			});
+			const string name = to_string(Frames) + " game frames, " + to_string(GameEntities) +
+				" entities, " + to_string(threads) + " threads";
+			report(name.c_str(), measure([&] {
+				for (int f = 0; f < Frames; ++f)
+					scheduler.run();
+			}));
+		}
+	}
+
+	// a frame laid out like main.cpp: two overlapping add() systems, then the
+	// wide movement as an exclusive system whose parallelEach fans out
+	void benchScheduled()
+	{
+		cout << "Scheduler frame, " << Entities << " entities, "
+			<< thread::hardware_concurrency() << " hardware threads\n";
+		for (int i = 0; i < Entities; ++i)
+			Entity::create().addAll(SchedPos{0,0}, SchedVel{1,1}, SchedHp{0});
+		World::step();
+
+		for (int threads : {1, 2, 4, 8, 16}) {
+			static ThreadPool* pool;
+			static double speed;
+			ThreadPool p(threads - 1);
+			pool = &p;
+			Scheduler scheduler(p);
+			scheduler.add<Reads<SchedPos>, Writes<SchedHp>>([] {
+				World::view<SchedPos,SchedHp>().each([](ent_type, const SchedPos& pos, SchedHp& hp) {
+					hp.hp += pos.x > 100;
+				});
+			});
+			scheduler.add<Reads<SchedVel>>([] {
+				World::view<SchedVel>().each([](ent_type, const SchedVel& vel) {
+					speed += vel.x;
+				});
+			});
+			scheduler.exclusive([] {
+				World::view<SchedPos,SchedVel>().parallelEach([](ent_type, SchedPos& pos, const SchedVel& vel) {
+					pos.x += vel.x;
+					pos.y += vel.y;
+				}, *pool);
+			});
+			const string name = to_string(threads) + " threads";
+			report(name.c_str(), measure([&] { scheduler.run(); }));
+		}
+	}
+
+	void benchSort()
+	{
+		constexpr int Sorted = 200000;
+		cout << "Morton sort, " << Sorted << " positions\n";
+		static ent_type ents[Sorted];
+		World::createEntities({ents, Sorted});
+		auto shuffle = [] {
+			World::sort<SortPos>([](const SortPos& p) { return uint32_t(p.x) * 2654435761u ^ uint32_t(p.y); });
+		};
+		uint32_t seed = 1;
+		for (ent_type e : ents) {
+			seed = seed * 1664525 + 1013904223;
+			World::addComponent(e, SortPos{float(seed % 4096), float((seed >> 12) % 4096)});
+		}
+		auto key = [](const SortPos& p) { return morton2D(uint32_t(p.x) / 16, uint32_t(p.y) / 16); };
+		static vector<ent_type> cells[64*64];
+		static double sum;
+		auto neighbours = [] {
+			for (const auto& cell : cells)
+				for (ent_type e : cell)
+					sum += World::getComponent<SortPos>(e).x;
+		};
+		shuffle();
+		for (ent_type e : ents) {
+			const SortPos& p = World::getComponent<SortPos>(e);
+			cells[int(p.y) / 64 * 64 + int(p.x) / 64].push_back(e);
+		}
+		report("unsorted neighbours", measure(neighbours));
+		report("full", measure([&key] { World::sort<SortPos>(key); }, shuffle));
+		World::sort<SortPos>(key);
+		report("sorted neighbours", measure(neighbours));
+		report("incremental, already sorted", measure([&key] { World::sort<SortPos>(key, SortMode::Incremental); }));
+	}
+
+	void benchSnapshot()
+	{
+		cout << "Snapshot, " << Entities << " entities with a sparse and a packed component\n";
+		static ent_type ents[Entities];
+		World::createEntities({ents, Entities}, SnapPos{1,2}, SnapHp{3});
+		const char* path = "bagel_bench_snapshot.bin";
+		report("save", measure([path] { World::saveSnapshot(path); }));
+		report("load", measure([path] { World::loadSnapshot(path); }));
+		remove(path);
+	}
+
+	template <class T>
+	void benchRareGet(const char* name, const vector<ent_type>& members)
+	{
+		static int sum;
+		report(name, measure([&] {
+			for (ent_type e : members)
+				sum += World::getComponent<T>(e).v;
+		}));
+	}
+	void benchRare()
+	{
+		cout << "Rare component on " << Entities/1000 << " of " << Entities << " entities, get by id\n";
+		static ent_type ents[Entities];
+		World::createEntities({ents, Entities});
+		vector<ent_type> members;
+		for (int i = 0; i < Entities; i += 1000) {
+			World::addComponents(ents[i], RareSparse{i}, RarePacked{i}, RareHash{i});
+			members.push_back(ents[i]);
+		}
+		benchRareGet<RareSparse>("sparse", members);
+		benchRareGet<RarePacked>("packed", members);
+		benchRareGet<RareHash>("hash", members);
+		const MemoryReport r = World::memoryReport();
+		for (index_type i = 0; i < r.storages.size(); ++i)
+			if (strncmp(r.storages[i].name, "{anonymous}::Rare", 17) == 0)
+				cout << "  " << r.storages[i].kind << " touched: " << r.storages[i].touched << " bytes\n";
+	}
+
+	void benchScan()
+	{
+		cout << "Mask scan, " << Entities << " masks\n";
+		static Mask masks[Entities];
+		static ent_type out[Entities];
+		Mask required, excluded;
+		required.set(Mask::bit(5));
+		required.set(Mask::bit(70));
+		excluded.set(Mask::bit(6));
+
+		for (int percent : {0, 1, 10, 50, 100}) {
+			for (int i = 0; i < Entities; ++i) {
+				masks[i].clear();
+				masks[i].set(Mask::bit(70));
+				if (i % 100 < percent)
+					masks[i].set(Mask::bit(5));
+				if (i % 7 == 0 && percent < 100)
+					masks[i].set(Mask::bit(6));
+			}
+			cout << " " << percent << "% required\n";
+			static size_type found;
+			report("test()", measure([&] {
+				found = 0;
+				for (int i = 0; i < Entities; ++i)
+					if (masks[i].test(required) && !masks[i].any(excluded))
+						out[found++] = {id_type(i)};
+			}));
+			report("scalar", measure([&] {
+				found = MaskScan::scalar(masks[0].data(), Entities, 0, required.data(), excluded.data(), out);
+			}));
+			report("dispatched", measure([&] {
+				found = MaskScan::run(masks, Entities, 0, required, excluded, out);
+			}));
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const char* only = argc > 1 ? argv[1] : nullptr;
+	auto run = [only](const char* name, void (*bench)()) {
+		if (only == nullptr || strcmp(only, name) == 0)
+			bench();
+	};
+	run("archetype", benchArchetype);
+	run("view", benchView);
+	run("bitset", benchBitset);
+	run("spawn", benchSpawn);
+	run("parallel", benchParallel);
+	run("scheduled", benchScheduled);
+	run("sort", benchSort);
+	run("snapshot", benchSnapshot);
+	run("scan", benchScan);
+	run("rare", benchRare);
+}
@@ -118,24 +118,32 @@ int main() {
     // === Entity Creation ===
     bagel::World::createEntity(); //Created So Player Entity won't have the id 0.
     int player_id = SpaceInvadersGame::CreatePlayerEntity(WINDOW_WIDTH / 2.0f - PLAYER_WIDTH / 2.0f, WINDOW_HEIGHT - 60.0f);
-    bagel::Entity player_entity(bagel::ent_type{player_id});
+    bagel::Entity player_entity(bagel::World::entity(bagel::id_type(player_id)));
     player_entity.get<SpaceInvadersGame::Collider>().width = PLAYER_WIDTH;
     player_entity.get<SpaceInvadersGame::Collider>().height = PLAYER_HEIGHT;
     player_entity.get<SpaceInvadersGame::RenderData>().spriteId = 0;
 
     int invaderStartX = 100;
     int invaderStartY = 60;
-    for (int row = 0; row < INVADER_ROWS; ++row) {
-        for (int col = 0; col < INVADER_COLS; ++col) {
-            float x = invaderStartX + col * (INVADER_WIDTH + INVADER_X_GAP);
-            float y = invaderStartY + row * (INVADER_HEIGHT + INVADER_Y_GAP);
-            int invader_id = SpaceInvadersGame::CreateEnemyEntity(x, y, 10);
-            bagel::Entity invader_entity(bagel::ent_type{invader_id});
-            invader_entity.get<SpaceInvadersGame::Collider>().width = INVADER_WIDTH;
-            invader_entity.get<SpaceInvadersGame::Collider>().height = INVADER_HEIGHT;
-            invader_entity.get<SpaceInvadersGame::RenderData>().spriteId = (row) % NUM_OF_INVADERS_TYPES;
-        }
-    }
+    SpaceInvadersGame::CreateEnemyGrid(invaderStartX, invaderStartY, INVADER_ROWS, INVADER_COLS, 10);
+
+    // === Systems ===
+    // systems that create or destroy entities run exclusively, the rest overlap
+    // whenever their component sets do not conflict. MovementSystem is exclusive
+    // too, so its parallelEach fans out over the pool instead of running serially
+    using namespace SpaceInvadersGame;
+    bagel::Scheduler scheduler;
+    scheduler.add<bagel::Reads<PlayerTag, Input>, bagel::Writes<Velocity>>(PlayerIntentSystem);
+    scheduler.exclusive(PlayerActionSystem);
+    scheduler.add<bagel::Reads<EnemyTag>, bagel::Writes<Position, Shoots>>(EnemyLogicSystem);
+    scheduler.exclusive(EnemyShootingSystem);
+    scheduler.add<bagel::Reads<>, bagel::Writes<PostureChanger>>(ChangeEnemyPostureSystem);
+    scheduler.exclusive(MovementSystem);
+    scheduler.exclusive(CollisionSystem);
+    scheduler.exclusive(HealthSystem);
+    scheduler.add<bagel::Reads<Dead, ScoreValue>>(ScoreSystem);
+    //scheduler.exclusive(DeleteOffscreenEntitiesSystem);
+    scheduler.exclusive(bagel::World::step);
 
     // === Game Loop ===
     bool quit = false;
@@ -148,7 +156,7 @@ int main() {
         // --- Input Handling ---
         SDL_PumpEvents(); // Make sure keyboard state is up to date
 
-        SpaceInvadersGame::Input& player_input = player_entity.get<SpaceInvadersGame::Input>();
+        SpaceInvadersGame::Input player_input = player_entity.get<SpaceInvadersGame::Input>();
         player_input.leftPressed = keystates[SDL_SCANCODE_LEFT];
         player_input.rightPressed = keystates[SDL_SCANCODE_RIGHT];
         player_input.firePressed = keystates[SDL_SCANCODE_SPACE];
@@ -166,18 +174,10 @@ int main() {
                 if (e.key.key == SDLK_SPACE) player_input.firePressed = false;
             }
         }
+        player_entity.get<SpaceInvadersGame::Input>() = player_input;
 
         // --- System Execution ---
-        SpaceInvadersGame::PlayerIntentSystem();
-        SpaceInvadersGame::PlayerActionSystem();
-        SpaceInvadersGame::EnemyLogicSystem();
-        SpaceInvadersGame::EnemyShootingSystem();
-        SpaceInvadersGame::ChangeEnemyPostureSystem();
-        SpaceInvadersGame::MovementSystem();
-        SpaceInvadersGame::CollisionSystem();
-        SpaceInvadersGame::HealthSystem();
-        SpaceInvadersGame::ScoreSystem();
-        //SpaceInvadersGame::DeleteOffscreenEntitiesSystem();
+        scheduler.run();
 
         // === Rendering ===
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
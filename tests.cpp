@@ -1,9 +1,62 @@
 #include <iostream>
 #include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "bagel.h"
 using namespace std;
 using namespace bagel;
 
+struct ArchPos { float x, y; };
+struct ArchVel { float x, y; };
+template <> struct bagel::Storage<ArchPos> { using type = ArchetypeStorage<ArchPos>; };
+template <> struct bagel::Storage<ArchVel> { using type = ArchetypeStorage<ArchVel>; };
+struct PackedHp { int hp; };
+template <> struct bagel::Storage<PackedHp> { using type = PackedStorage<PackedHp>; };
+struct ViewPos { float x, y; };
+struct ViewTag {};
+template <> struct bagel::Storage<ViewPos> { using type = PackedStorage<ViewPos>; };
+struct GroupPos { float x, y; };
+struct GroupVel { float x, y; };
+template <> struct bagel::Storage<GroupPos> { using type = PackedStorage<GroupPos>; };
+template <> struct bagel::Storage<GroupVel> { using type = PackedStorage<GroupVel>; };
+struct RegA { int v; };
+struct RegB { float x; };
+template <> struct bagel::Storage<RegB> { using type = PackedStorage<RegB>; };
+struct RegTag {};
+using RegisteredComponents = Components<RegA, RegB, RegTag>;
+BAGEL_COMPONENTS(RegisteredComponents);
+struct BitA { int v; };
+struct MemA { int v; };
+struct MemB { double d; };
+struct MemTag {};
+template <> struct bagel::Storage<MemB> { using type = PackedStorage<MemB>; };
+struct BigBlob { char bytes[256]; };
+struct Flags { bool a, b, c; };
+template <> struct bagel::BitWidth<Flags> : std::integral_constant<int, 3> {};
+struct Rare { int v; };
+template <> struct bagel::Storage<Rare> { using type = HashStorage<Rare>; };
+struct RareList { vector<int> items; };
+template <> struct bagel::Storage<RareList> { using type = HashStorage<RareList>; };
+struct BitB { int v; };
+struct Waypoints {
+	vector<int> points;
+	unique_ptr<int> owner;
+
+	Waypoints(int n, int first) : owner(new int(first)) {
+		for (int i = 0; i < n; ++i)
+			points.push_back(first + i);
+	}
+	Waypoints(Waypoints&&) = default;
+	Waypoints& operator=(Waypoints&&) = default;
+};
+
 void test1() {
 	ent_type e0 = World::createEntity();
 	assert(e0.id == 0 && "First id is not 0");
@@ -18,7 +71,1009 @@ void test1() {
 	cout << "Test 1 passed\n";
 }
 
+void test2() {
+	Entity a = Entity::create(), b = Entity::create(), c = Entity::create();
+	a.addAll(ArchPos{1,1}, ArchVel{1,0});
+	b.add(ArchPos{2,2});
+	c.addAll(ArchPos{3,3}, ArchVel{0,1});
+	assert(Archetypes::location(a.entity()).archetype == Archetypes::location(c.entity()).archetype
+		&& "Entities with the same mask not in the same archetype");
+
+	a.del<ArchVel>();
+	assert(a.get<ArchPos>().x == 1 && "Component lost when moving between archetypes");
+	assert(c.get<ArchVel>().y == 1 && "Component lost after swap-remove");
+
+	int n = 0;
+	Archetypes::each<ArchPos,ArchVel>([&n](ent_type, ArchPos& p, const ArchVel& v) {
+		p.x += v.x;
+		p.y += v.y;
+		++n;
+	});
+	assert(n == 1 && c.get<ArchPos>().y == 4 && "Archetype query visited wrong entities");
+
+	a.destroy(); b.destroy(); c.destroy();
+	cout << "Test 2 passed\n";
+}
+
+void test3() {
+	PagedBag<index_type,-1> index;
+	assert(index.get(9000000) == -1 && "Unset paged entry is not null");
+	index[9000000] = 7;
+	index[9000001] = 8;
+	assert(index.get(9000000) == 7 && index.get(0) == -1 && "Paged entry lost");
+	assert(index.committedPages() == 1 && "Paged index committed untouched pages");
+
+	Entity a = Entity::create(), b = Entity::create();
+	a.add(PackedHp{1});
+	b.add(PackedHp{2});
+	a.del<PackedHp>();
+	a.del<PackedHp>();
+	assert(PackedStorage<PackedHp>::size() == 1 && b.get<PackedHp>().hp == 2 && "Packed swap-remove broken");
+	assert(!PackedStorage<PackedHp>::has(a.entity()) && "Deleted packed component still indexed");
+
+	a.destroy(); b.destroy();
+	cout << "Test 3 passed\n";
+}
+
+void test4() {
+	VirtualBag<char,1> bag;
+	for (int i = 0; i < 10000; ++i)
+		bag.push(static_cast<char>(i));
+	assert(bag[9999] == static_cast<char>(9999) && "VirtualBag lost pushed elements");
+
+	const size_type past = static_cast<size_type>(bag.reserved()) + 1;
+	bag.ensure(past+1);
+	bag[past] = 1;
+	assert(bag[0] == 0 && bag[past] == 1 && "VirtualBag lost elements growing past its reservation");
+	assert(bag[past-1] == 0 && "VirtualBag committed memory is not zeroed");
+
+	cout << "Test 4 passed\n";
+}
+
+void test5() {
+	Entity a = Entity::create(), b = Entity::create(), c = Entity::create();
+	a.addAll(ViewPos{1,0}, PackedHp{5});
+	b.addAll(ViewPos{2,0}, ViewTag{});
+	c.add(PackedHp{6});
+
+	int n = 0;
+	for (ent_type e : World::view<ViewPos>().exclude<ViewTag>()) {
+		assert(e.id == a.entity().id && "View returned an excluded entity");
+		++n;
+	}
+	assert(n == 1 && "View missed an entity");
+
+	float sum = 0;
+	int hp = 0;
+	World::view<ViewPos>().optional<PackedHp>().each([&](ent_type e, ViewPos& p, PackedHp* h) {
+		sum += p.x;
+		if (h != nullptr)
+			hp += h->hp;
+		World::delComponent<ViewPos>(e);
+	});
+	assert(sum == 3 && hp == 5 && "View each() visited wrong components");
+	assert(PackedStorage<ViewPos>::size() == 0 && "Removing during each() skipped entities");
+
+	a.destroy(); b.destroy(); c.destroy();
+	cout << "Test 5 passed\n";
+}
+
+void test6() {
+	Entity first = Entity::create();
+	ent_type ents[300];
+	for (ent_type& e : ents)
+		e = World::createEntity();
+	for (int i = 0; i < 300; ++i) {
+		Entity e(ents[i]);
+		if (i % 3 == 0)
+			e.add(BitA{i});
+		if (i % 5 == 0)
+			e.add(BitB{i});
+	}
+
+	int n = 0, sum = 0;
+	World::view<BitA>().exclude<BitB>().each([&](ent_type, const BitA& a) {
+		++n;
+		sum += a.v;
+	});
+	assert(n == 80 && sum == 14850 - 2850 && "Bitset view matched wrong entities");
+
+	n = 0;
+	for (ent_type e : World::view<BitA,BitB>()) {
+		assert(Entity(e).get<BitA>().v % 15 == 0 && "Bitset iterator returned a non-match");
+		World::destroyEntity(e);
+		++n;
+	}
+	assert(n == 20 && "Bitset iterator missed entities");
+	assert(((World::bitWord(Component<BitB>::Index, ents[0].id / WordBits) >> (ents[0].id % WordBits)) & 1) == 0 &&
+		"Destroyed entity left its bit set");
+
+	for (ent_type e : ents)
+		if (World::mask(e).test(Component<BitA>::Bit) || World::mask(e).test(Component<BitB>::Bit))
+			World::destroyEntity(e);
+	first.destroy();
+	cout << "Test 6 passed\n";
+}
+
+void test7() {
+	Mask masks[1000], required, excluded;
+	required.set(Mask::bit(3));
+	required.set(Mask::bit(40));
+	excluded.set(Mask::bit(70));
+	for (int i = 0; i < 1000; ++i) {
+		for (int b : {3, 40, 70})
+			if ((i / (b % 7 + 1)) % 2 != 0)
+				masks[i].set(Mask::bit(b));
+	}
+
+	ent_type expected[1000], found[1000];
+	const size_type n = MaskScan::scalar(masks[0].data(), 1000, 5, required.data(), excluded.data(), expected);
+	assert(n > 0 && expected[0].id >= 5 && "Scalar mask scan found nothing");
+	assert(MaskScan::run(masks, 1000, 5, required, excluded, found) == n &&
+		equal(expected, expected + n, found, [](ent_type a, ent_type b) { return a.id == b.id; }) &&
+		"Dispatched mask scan disagrees with scalar scan");
+#if defined(__x86_64__)
+	assert(MaskScan::sse2(masks[0].data(), 1000, 5, required.data(), excluded.data(), found) == n &&
+		equal(expected, expected + n, found, [](ent_type a, ent_type b) { return a.id == b.id; }) &&
+		"SSE2 mask scan disagrees with scalar scan");
+#endif
+
+	Entity a = Entity::create();
+	a.add(BitA{1});
+	int visited = 0;
+	World::view<>().exclude<BitA>().each([&](ent_type e) {
+		assert(e.id != a.entity().id && "Scan view returned an excluded entity");
+		++visited;
+	});
+	assert(visited > 0 && "Scan view found nothing");
+	a.destroy();
+	cout << "Test 7 passed\n";
+}
+
+void test8() {
+	Entity a = Entity::create(), b = Entity::create();
+	a.add(BitA{1});
+	b.add(BitA{2});
+
+	CommandBuffer main, worker;
+	worker.add(a.entity(), BitB{20});
+	ent_type created = worker.create();
+	worker.add(created, BitA{3});
+	main.add(a.entity(), BitB{10});
+	main.del<BitA>(a.entity());
+	main.destroy(b.entity());
+	ent_type mainCreated = main.create();
+	main.add(mainCreated, BitB{30});
+	main.merge(worker);
+	assert(worker.empty() && main.size() == 8 && "Merge lost commands");
+	assert(World::mask(a.entity()).test(Component<BitA>::Bit) && "Commands applied before playback");
+
+	main.playback();
+	assert(main.empty() && "Playback kept commands");
+	assert(!a.has<BitA>() && a.get<BitB>().v == 20 && "Merged commands not applied after the target's own");
+	assert(!b.has<BitA>() && "Destroy not applied");
+
+	int found = 0;
+	World::view<BitA>().each([&](ent_type e, const BitA& v) {
+		if (v.v == 3) {
+			++found;
+			World::destroyEntity(e);
+		}
+	});
+	World::view<BitB>().each([&](ent_type e, const BitB& v) {
+		if (v.v == 30) {
+			++found;
+			World::destroyEntity(e);
+		}
+	});
+	assert(found == 2 && "Deferred creates not resolved");
+
+	a.destroy();
+	cout << "Test 8 passed\n";
+}
+
+void test9() {
+	ent_type ents[1000];
+	const size_type added = World::sizeAdded();
+	World::createEntities({ents, 1000}, ViewPos{1,2}, BitA{7});
+	assert(World::sizeAdded() == added + 1000 && "Expected one structural record per entity");
+
+	int count = 0;
+	World::view<ViewPos,BitA>().each([&](ent_type, ViewPos& p, const BitA& a) {
+		assert(p.x == 1 && p.y == 2 && a.v == 7 && "Bulk components not written");
+		++count;
+	});
+	assert(count == 1000 && "Bulk created entities missing from view");
+	for (index_type i = 0; i < 1000; ++i) {
+		const AddedMask& rec = World::getAdded(added + i);
+		assert(rec.e.id == ents[i].id && rec.next == World::mask(ents[i]) && "Wrong structural record");
+	}
+
+	World::addComponents(Span<const ent_type>{ents + 500, 500}, BitB{3});
+	assert(!Entity(ents[499]).has<BitB>() && Entity(ents[500]).get<BitB>().v == 3 && "Batched insert hit wrong entities");
+	assert(World::sizeAdded() == added + 1500 && "Expected one structural record per entity");
+
+	for (ent_type e : ents)
+		World::destroyEntity(e);
+	const id_type maxId = World::maxId().id;
+	World::createEntities({ents, 10});
+	assert(World::maxId().id == maxId && "Recycled ids not reused");
+	for (index_type i = 0; i < 10; ++i) {
+		assert(World::mask(ents[i]) == Mask{} && "Recycled entity kept components");
+		World::destroyEntity(ents[i]);
+	}
+	cout << "Test 9 passed\n";
+}
+
+void test10() {
+	static_assert(is_same_v<Storage<Waypoints>::type, PackedStorage<Waypoints>>,
+		"Non-trivial components should default to packed storage");
+	vector<Entity> ents;
+	for (index_type i = 0; i < 100; ++i) {
+		Entity e = ents.emplace_back(Entity::create());
+		if (e.entity().id % 2)
+			e.emplace<Waypoints>(3, e.entity().id);
+		else
+			e.add(Waypoints(3, e.entity().id));
+	}
+	for (index_type i = 0; i < 100; i += 3)
+		ents[i].del<Waypoints>();
+	for (index_type i = 0; i < 100; ++i) {
+		if (i % 3 == 0)
+			continue;
+		const Waypoints& w = ents[i].get<Waypoints>();
+		const int id = ents[i].entity().id;
+		assert(w.points.size() == 3 && w.points[2] == id + 2 && *w.owner == id && "Component corrupted when moved");
+	}
+	assert(PackedStorage<Waypoints>::size() == 66 && "Deleted components not removed");
+
+	DynamicBag<string,1> names;
+	for (int i = 0; i < 50; ++i)
+		names.emplace(40, 'a' + i % 26);
+	assert(names.pop() == string(40, 'a' + 49 % 26) && names[0] == string(40, 'a') && "Strings lost on growth");
+
+	for (Entity& e : ents)
+		e.destroy();
+	cout << "Test 10 passed\n";
+}
+
+void test11() {
+	for (size_type workers : {0, 3}) {
+		atomic<int> clock{0};
+		int writeA = 0, readA = 0, other = 0, last = 0;
+		ThreadPool pool(workers);
+		Scheduler scheduler(pool);
+		scheduler.exclusive([&] { last = ++clock; });
+		scheduler.add<Reads<>, Writes<BitA>>([&] { writeA = ++clock; });
+		scheduler.add<Reads<BitA>, Writes<BitB>>([&] { readA = ++clock; });
+		scheduler.add<Reads<BitB>>([&] { other = ++clock; });
+		mutex threadsLock;
+		vector<thread::id> threads;
+		scheduler.add<Reads<ViewPos>>([&] {
+			++clock;
+			lock_guard<mutex> lock(threadsLock);
+			if (find(threads.begin(), threads.end(), this_thread::get_id()) == threads.end())
+				threads.push_back(this_thread::get_id());
+		});
+		const thread::id caller = this_thread::get_id();
+		scheduler.exclusive([&] {
+			assert(this_thread::get_id() == caller && "Exclusive system not run on the caller");
+			last = ++clock;
+		});
+		// every chunk waits for the others, which only a fanned out parallelFor satisfies
+		atomic<int> arrived{0};
+		atomic<bool> fanned{true};
+		Scheduler wide(pool);
+		wide.exclusive([&] {
+			pool.parallelFor(0, pool.threads(), 1, [&](index_type, index_type) {
+				++arrived;
+				const auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+				while (arrived < pool.threads() && chrono::steady_clock::now() < deadline)
+					this_thread::yield();
+				if (arrived < pool.threads())
+					fanned = false;
+			});
+		});
+		wide.run();
+		assert(fanned && "parallelFor inside an exclusive system ran serially");
+		for (int frame = 0; frame < 100; ++frame) {
+			clock = 0;
+			scheduler.run();
+			assert(clock == 6 && "Not every system ran once");
+			assert(writeA < readA && readA < other && "Conflicting systems not run in order");
+			assert(last == 6 && "Exclusive system did not run alone");
+		}
+		assert(scheduler.workers() == workers && threads.size() <= size_t(workers) + 1 && "Systems ran outside the pool");
+	}
+	cout << "Test 11 passed\n";
+}
+
+void test12() {
+	ThreadPool pool(3);
+	atomic<long long> sum{0};
+	pool.parallelFor(10, 100010, 1000, [&](index_type b, index_type e) {
+		assert(b % 1000 == 10 && e - b <= 1000 && "Chunk not aligned to grain");
+		long long local = 0;
+		for (index_type i = b; i < e; ++i)
+			local += i;
+		pool.parallelFor(0, 4, 1, [&](index_type, index_type) { local += 0; });
+		sum += local;
+	});
+	assert(sum == (100010LL*100009 - 10LL*9) / 2 && "parallelFor missed or repeated indices");
+
+	ent_type ents[10000];
+	World::createEntities({ents, 10000}, BitA{0});
+	for (index_type i = 0; i < 10000; i += 2)
+		World::addComponent(ents[i], ViewPos{0,0});
+	atomic<int> visited{0};
+	World::view<ViewPos,BitA>().parallelEach([&](ent_type, ViewPos& p, BitA& a) {
+		p.x += 1;
+		a.v += 1;
+		++visited;
+	}, pool);
+	World::view<BitA>().exclude<ViewPos>().parallelEach([&](ent_type, BitA& a) {
+		a.v += 10;
+		++visited;
+	}, pool);
+	World::view<>().exclude<BitB>().parallelEach([&](ent_type e) {
+		if (World::mask(e).test(Component<BitA>::Bit))
+			World::getComponent<BitA>(e).v += 100;
+	}, pool);
+	assert(visited == 10000 && "parallelEach visited wrong entity count");
+	for (index_type i = 0; i < 10000; ++i) {
+		const int expected = (i % 2 == 0 ? 1 : 10) + 100;
+		assert(World::getComponent<BitA>(ents[i]).v == expected && "Entity visited more or less than once");
+	}
+	for (ent_type e : ents)
+		World::destroyEntity(e);
+	cout << "Test 12 passed\n";
+}
+
+void test13() {
+	World::step();
+	Entity a = Entity::create(), b = Entity::create(), c = Entity::create();
+	a.addAll(ViewPos{0,0}, BitA{0});
+	b.addAll(ViewPos{0,0}, BitA{0});
+	c.add(BitA{0});
+	assert(a.has<ViewPos>() && World::changed<ViewPos>(a.entity()) && "Added component not marked changed");
+	assert(World::changed<ViewPos>().size == 2 && "Changed list has wrong size");
+
+	World::step();
+	assert(!World::changed<ViewPos>(a.entity()) && World::changed<ViewPos>().size == 0 && "Changes survived step");
+	b.getMut<ViewPos>().x = 5;
+	b.markChanged<ViewPos>();
+	c.markChanged<BitA>();
+	assert(World::changed<ViewPos>().size == 1 && "Component marked twice in one frame");
+
+	int count = 0;
+	World::view<ViewPos>().changed<ViewPos>().each([&](ent_type e, ViewPos& p) {
+		assert(e.id == b.entity().id && p.x == 5 && "Unchanged entity in changed view");
+		++count;
+	});
+	for (ent_type e : World::view<BitA>().changed<BitA>().exclude<ViewPos>()) {
+		assert(e.id == c.entity().id && "exclude() dropped the changed filter");
+		++count;
+	}
+	assert(count == 2 && "Changed entity missing from view");
+
+	b.destroy();
+	Entity d = Entity::create();
+	d.add(BitB{0});
+	assert(d.entity().id == b.entity().id && !World::changed<ViewPos>(d.entity()) && "Recycled entity inherited a change");
+	for (ent_type e : World::view<>().changed<ViewPos>())
+		assert(e.id != d.entity().id && "Recycled entity in changed view");
+	a.destroy();
+	c.destroy();
+	d.destroy();
+
+	World::step();
+	Entity e = Entity::create();
+	e.add(ViewPos{0,0});
+	e.del<ViewPos>();
+	assert(!World::changed<ViewPos>(e.entity()) && "Removed component still changed");
+	e.add(ViewPos{1,1});
+	assert(World::changed<ViewPos>(e.entity()) && World::changed<ViewPos>().size == 1 && "Re-added component listed twice");
+	e.del<ViewPos>();
+	e.destroy();
+	Entity f = Entity::create();
+	f.add(ViewPos{2,2});
+	assert(f.entity().id == e.entity().id && World::changed<ViewPos>().size == 2 && "Recycled entity not listed");
+	f.destroy();
+	World::step();
+	cout << "Test 13 passed\n";
+}
+
+void test14() {
+	World::step();
+	Entity a = Entity::create(), b = Entity::create();
+	a.addAll(BitA{1}, BitB{1});
+	ReactiveSystem<TypeList<BitA>, TypeList<ViewTag>> sys;
+	assert(sys.size() == 1 && sys.contains(a.entity()) && "Existing entities not picked up");
+
+	b.add(BitA{2});
+	Entity c = Entity::create();
+	c.addAll(BitA{3}, ViewTag{});
+	int sum = 0;
+	sys.each([&](ent_type, BitA& v) { sum += v.v; });
+	assert(sum == 3 && sys.size() == 2 && "Adds not applied");
+
+	a.del<BitA>();
+	c.del<ViewTag>();
+	assert(sys.entities().size == 2 && !sys.contains(a.entity()) && sys.contains(c.entity()) && "Removals not applied");
+
+	World::step();
+	b.destroy();
+	Entity d = Entity::create();
+	assert(d.entity().id == b.entity().id);
+	assert(!sys.contains(d.entity()) && sys.entities().size == 1 && "Destroy not applied");
+	d.add(BitA{4});
+	c.destroy();
+	World::step();
+	assert(sys.size() == 1 && sys.contains(d.entity()) && "Records dropped by step()");
+
+	a.destroy();
+	const AddedMask& rec = World::getAdded(World::sizeAdded() - 1);
+	assert(rec.destroyed && rec.e.id == a.entity().id && rec.next == Mask{} && "Destroy not recorded");
+	d.destroy();
+	cout << "Test 14 passed\n";
+}
+
+void test15() {
+	Entity ents[20] = {Entity::create(), Entity::create(), Entity::create(), Entity::create(), Entity::create(),
+		Entity::create(), Entity::create(), Entity::create(), Entity::create(), Entity::create(),
+		Entity::create(), Entity::create(), Entity::create(), Entity::create(), Entity::create(),
+		Entity::create(), Entity::create(), Entity::create(), Entity::create(), Entity::create()};
+	for (index_type i = 0; i < 20; ++i) {
+		ents[i].add(GroupPos{float(i), 0});
+		if (i % 3 == 0)
+			ents[i].add(GroupVel{1, float(i)});
+	}
+	auto group = World::group<GroupPos,GroupVel>();
+	auto check = [&group] {
+		const Span<const ent_type> members = group.entities();
+		for (index_type i = 0; i < members.size; ++i) {
+			assert(PackedStorage<GroupPos>::entity(i).id == members[i].id &&
+				PackedStorage<GroupVel>::entity(i).id == members[i].id && "Owned storages out of order");
+			assert(group.components<GroupPos>()[i].x == group.components<GroupVel>()[i].y && "Components not co-sorted");
+		}
+		for (index_type i = members.size; i < PackedStorage<GroupPos>::size(); ++i)
+			assert(!World::mask(PackedStorage<GroupPos>::entity(i)).test(Component<GroupVel>::Bit) && "Member outside the group");
+	};
+	assert(group.size() == 7 && "Existing entities not grouped");
+	check();
+
+	ents[1].add(GroupVel{1, 1});
+	ents[3].del<GroupVel>();
+	ents[6].del<GroupPos>();
+	ents[9].destroy();
+	assert(group.size() == 5 && "Group membership not maintained");
+	check();
+
+	float sum = 0;
+	group.each([&](ent_type e, GroupPos& p, GroupVel& v) {
+		p.x += v.x;
+		sum += p.x;
+		if (e.id == ents[12].entity().id)
+			ents[12].del<GroupVel>();
+	});
+	assert(sum == (0+1) + (1+1) + (12+1) + (15+1) + (18+1) && group.size() == 4 && "Group each wrong");
+	for (index_type i = 0; i < 20; ++i)
+		if (i != 9)
+			ents[i].destroy();
+	assert(group.size() == 0 && "Destroyed members left in group");
+	cout << "Test 15 passed\n";
+}
+
+void test16() {
+	static_assert(morton2D(1, 0) == 1 && morton2D(0, 1) == 2 && morton2D(3, 3) == 15, "morton2D wrong");
+	vector<Entity> ents;
+	for (index_type i = 0; i < 30; ++i) {
+		ents.push_back(Entity::create());
+		ents[i].add(GroupPos{float(30 - i), 0});
+		if (i % 4 == 0)
+			ents[i].add(GroupVel{0, float(30 - i)});
+	}
+	auto group = World::group<GroupPos,GroupVel>();
+	auto check = [&group] {
+		const index_type n = PackedStorage<GroupPos>::size();
+		for (index_type i = 0; i < n; ++i) {
+			const ent_type e = PackedStorage<GroupPos>::entity(i);
+			assert(PackedStorage<GroupPos>::index(e) == i && "Sparse index not patched");
+			assert(World::getComponent<GroupPos>(e).x == PackedStorage<GroupPos>::get(i).x && "Component moved apart from its entity");
+			if (i + 1 != group.size() && i + 1 < n)
+				assert(PackedStorage<GroupPos>::get(i).x <= PackedStorage<GroupPos>::get(i+1).x && "Not sorted");
+		}
+		for (index_type i = 0; i < group.size(); ++i)
+			assert(group.components<GroupPos>()[i].x == group.components<GroupVel>()[i].y && "Owned storages not co-sorted");
+	};
+	auto byX = [](const GroupPos& p) { return p.x; };
+	World::sort<GroupPos>(byX);
+	assert(group.size() == 8 && "Sort changed group membership");
+	check();
+
+	World::getComponent<GroupPos>(ents[5].entity()).x = 0.5f;
+	World::getComponent<GroupPos>(ents[8].entity()).x = 40;
+	World::getComponent<GroupVel>(ents[8].entity()).y = 40;
+	World::sort<GroupPos>(byX, SortMode::Incremental);
+	check();
+	assert(PackedStorage<GroupPos>::get(group.size()).x == 0.5f && "Incremental sort wrong");
+
+	for (Entity& e : ents)
+		e.destroy();
+	cout << "Test 16 passed\n";
+}
+
+void test17() {
+	constexpr int N = 100;
+	ent_type ents[N], victims[N/2 + 1];
+	const int packed = PackedStorage<PackedHp>::size();
+	World::createEntities({ents, N}, PackedHp{0}, BitA{0});
+	for (int i = 0; i < N; ++i) {
+		World::getComponent<PackedHp>(ents[i]).hp = i;
+		if (i % 3 == 0)
+			World::addComponents(ents[i], GroupPos{float(i), 0}, GroupVel{0, float(i)});
+	}
+	auto group = World::group<GroupPos,GroupVel>();
+	const size_type members = group.size();
+	int n = 0;
+	for (int i = 0; i < N; i += 2)
+		victims[n++] = ents[i];
+
+	World::destroyEntities({victims, size_type(n)});
+	assert(PackedStorage<PackedHp>::size() == packed + N/2 && "Packed components not deleted");
+	assert(group.size() == members - 17 && "Group not updated on batch destroy");
+	for (int i = 0; i < N; ++i) {
+		assert(World::mask(ents[i]).test(Component<PackedHp>::Bit) == (i % 2 == 1) && "Wrong entities destroyed");
+		if (i % 2 == 1)
+			assert(World::getComponent<PackedHp>(ents[i]).hp == i && "Surviving component moved apart from its entity");
+	}
+	int seen = 0;
+	World::view<PackedHp,BitA>().each([&](ent_type, PackedHp&, BitA&) { ++seen; });
+	assert(seen == N/2 && "Bitsets not cleared on batch destroy");
+
+	CommandBuffer commands;
+	for (int i = 1; i < N; i += 2) {
+		commands.destroy(ents[i]);
+		commands.destroy(ents[i]);
+	}
+	commands.playback();
+	assert(PackedStorage<PackedHp>::size() == packed && group.size() == members - 34 && "Buffered destroys not batched");
+	ent_type reused[N];
+	World::createEntities({reused, N});
+	sort(reused, reused + N, [](ent_type a, ent_type b) { return a.id < b.id; });
+	for (int i = 1; i < N; ++i)
+		assert(reused[i-1].id != reused[i].id && "Id recycled twice");
+	World::destroyEntities({reused, N});
+
+	ent_type twice[2];
+	twice[0] = twice[1] = World::createEntity();
+	World::destroyEntities({twice, 2});
+	const ent_type first = World::createEntity(), second = World::createEntity();
+	assert(first.id != second.id && "Repeated handle freed twice");
+	World::destroyEntity(first);
+	World::destroyEntity(second);
+	cout << "Test 17 passed\n";
+}
+
+index_type otherUnitIndex();
+template <class ...Ts>
+bool unlistedDistinct(index_type i) { return ((componentIndex<Ts>() != i) && ...); }
+template <class ...Ts>
+bool unlistedAbove(index_type listed) { return ((componentIndex<Ts>() > listed) && ...); }
+
+void test18() {
+	static_assert(Component<RegA>::Index == 0 && Component<RegB>::Index == 1 && Component<RegTag>::Index == 2,
+		"Registered indices not assigned in list order");
+	static_assert(Component<RegB>::Index == Component<RegA>::Index + 1 && Component<RegTag>::Index == Component<RegB>::Index + 1,
+		"Listed indices not distinct and consecutive");
+	static_assert(!RegisteredComponents::contains<BitA>, "Unlisted component reported as registered");
+	constexpr Mask both = MaskBuilder().set<RegA>().set<RegB>().build();
+	static_assert(both.test(Component<RegA>::Bit) && !both.test(Component<RegTag>::Bit), "Mask not built at compile time");
+	const bool above = unlistedAbove<ArchPos, ArchVel, PackedHp, ViewPos, ViewTag, GroupPos, GroupVel,
+		BitA, MemA, MemB, MemTag, BigBlob, Flags, Rare, RareList, BitB, Waypoints>(Component<RegTag>::Index);
+	assert(above && otherUnitIndex() > Component<RegTag>::Index && "Unlisted index collides with the list");
+	const bool distinct = unlistedDistinct<ArchPos, ArchVel, PackedHp, ViewPos, ViewTag, GroupPos, GroupVel,
+		BitA, MemA, MemB, MemTag, BigBlob, Flags, Rare, RareList, BitB, Waypoints>(otherUnitIndex());
+	assert(distinct && "Unlisted index collides with another translation unit");
+
+	Entity a = Entity::create(), b = Entity::create();
+	a.addAll(RegA{1}, RegB{2}, RegTag{});
+	b.addAll(RegA{3}, BitA{4});
+	assert(a.test(both) && !b.test(both) && b.has<RegA>() && "Registered bits not set");
+	int sum = 0;
+	World::view<RegA>().exclude<RegTag>().each([&](ent_type, RegA& r) { sum += r.v; });
+	assert(sum == 3 && "View over registered components wrong");
+	assert(a.get<RegB>().x == 2 && "Registered packed component lost");
+	a.destroy();
+	b.destroy();
+	cout << "Test 18 passed\n";
+}
+
+void test19() {
+	const char* path = "bagel_test_snapshot.bin";
+	ReactiveSystem<TypeList<BitA>> withA;
+	vector<ent_type> ents(50);
+	World::createEntities({ents.data(), 50}, BitA{0});
+	for (int i = 0; i < 50; ++i) {
+		World::getComponent<BitA>(ents[i]).v = i;
+		if (i % 2 == 0)
+			World::addComponent(ents[i], ViewPos{float(i), 0});
+		if (i % 5 == 0)
+			World::addComponents(ents[i], GroupPos{float(i), 0}, GroupVel{0, float(i)});
+	}
+	World::destroyEntity(ents[7]);
+	World::destroyEntity(ents[10]);
+	const size_type members = World::group<GroupPos,GroupVel>().size();
+	assert(World::saveSnapshot(path) && "Snapshot not written");
+
+	Entity arch = Entity::create();
+	arch.add(ArchPos{1, 1});
+	assert(!World::saveSnapshot("bagel_test_unsaved.bin") && "Archetype component saved");
+	arch.destroy();
+	for (int i = 0; i < 50; ++i)
+		if (i != 7 && i != 10)
+			World::destroyEntity(ents[i]);
+	Entity stranger = Entity::create();
+	stranger.addAll(ViewPos{-1, -1}, GroupPos{-1, 0}, GroupVel{0, -1});
+	assert(!World::loadSnapshot("bagel_test_missing.bin") && stranger.has<ViewPos>() && "Failed load changed the world");
+
+	vector<unsigned char> file;
+	FILE* in = fopen(path, "rb");
+	for (int c; (c = fgetc(in)) != EOF; )
+		file.push_back(c);
+	fclose(in);
+	const char* broken = "bagel_test_broken.bin";
+	auto loadBroken = [&](size_t bytes) {
+		FILE* out = fopen(broken, "wb");
+		fwrite(file.data(), 1, bytes, out);
+		fclose(out);
+		const bool loaded = World::loadSnapshot(broken);
+		std::remove(broken);
+		return loaded;
+	};
+	for (size_t cut : {size_t(0), file.size()/3, file.size()/2, file.size()-1})
+		assert(!loadBroken(cut) && stranger.has<ViewPos>() && "Truncated snapshot changed the world");
+	// the section itself is whole, but ViewPos's payload counts one component too many
+	const uint64_t key = typeKey<ViewPos>();
+	size_t at = 0;
+	while (memcmp(&file[at], &key, sizeof(key)) != 0)
+		++at;
+	const size_t count = at + 3*sizeof(uint64_t) + 2*sizeof(uint32_t);
+	uint32_t n;
+	memcpy(&n, &file[count], sizeof(n));
+	++n;
+	memcpy(&file[count], &n, sizeof(n));
+	assert(!loadBroken(file.size()) && stranger.has<ViewPos>() && "Short payload changed the world");
+
+	assert(World::loadSnapshot(path) && "Snapshot not loaded");
+	std::remove(path);
+	for (int i = 0; i < 50; ++i) {
+		const Mask& m = World::mask(ents[i]);
+		if (i == 7 || i == 10) {
+			assert(m == Mask{} && "Destroyed entity restored");
+			continue;
+		}
+		assert(World::getComponent<BitA>(ents[i]).v == i && "Sparse component not restored");
+		assert(m.test(Component<ViewPos>::Bit) == (i % 2 == 0) && "Mask not restored");
+		if (i % 2 == 0)
+			assert(World::getComponent<ViewPos>(ents[i]).x == i && "Packed component not restored");
+	}
+	int found = 0;
+	World::view<ViewPos>().each([&](ent_type, ViewPos&) { ++found; });
+	assert(found == 24 && "Bitsets not restored");
+	auto group = World::group<GroupPos,GroupVel>();
+	assert(group.size() == members && "Group not rebuilt");
+	for (index_type i = 0; i < group.size(); ++i)
+		assert(group.components<GroupPos>()[i].x == group.components<GroupVel>()[i].y && "Group order lost");
+	assert(withA.size() == 48 && "Reactive system not rescanned");
+	const ent_type reused = World::createEntity();
+	assert((reused.id == ents[7].id || reused.id == ents[10].id) && "Free ids not restored");
+	World::destroyEntity(reused);
+
+	for (int i = 0; i < 50; ++i)
+		if (i != 7 && i != 10)
+			World::destroyEntity(ents[i]);
+
+	Registry registry;
+	Registry::Scope scope(registry);
+	vector<ent_type> many(20000);
+	World::createEntities({many.data(), 20000}, BitA{1});
+	assert(World::saveSnapshot(path) && World::loadSnapshot(path) && "Snapshot not reloaded");
+	std::remove(path);
+	ThreadPool pool(3);
+	World::view<BitA>().parallelEach([](ent_type e, BitA&) { World::markChanged<BitA>(e); }, pool);
+	assert(World::changed<BitA>().size == 20000 && "Loaded components not marked changed");
+	cout << "Test 19 passed\n";
+}
+
+void test20() {
+	const ent_type outside = World::createEntity();
+	World::addComponent(outside, BitA{-1});
+	auto simulate = [](int n, int* result) {
+		Registry registry;
+		Registry::Scope scope(registry);
+		vector<ent_type> ents(n);
+		World::createEntities({ents.data(), size_type(n)}, BitA{1}, ViewPos{0, 0});
+		for (int step = 0; step < 10; ++step) {
+			World::view<BitA,ViewPos>().each([](ent_type, BitA& a, ViewPos& p) { p.x += a.v; });
+			World::step();
+		}
+		int sum = 0;
+		World::view<ViewPos>().each([&](ent_type, ViewPos& p) { sum += int(p.x); });
+		*result = World::maxId().id + 1 == n ? sum : -1;
+	};
+	int a = 0, b = 0;
+	thread ta(simulate, 100, &a), tb(simulate, 300, &b);
+	ta.join();
+	tb.join();
+	assert(a == 1000 && b == 3000 && "Registries not independent");
+	assert(World::getComponent<BitA>(outside).v == -1 && "Global registry touched by another registry");
+
+	const id_type globalMax = World::maxId().id;
+	Registry local;
+	{
+		Registry::Scope scope(local);
+		assert(World::maxId().id == -1 && "New registry not empty");
+		Entity e = Entity::create();
+		e.addAll(ViewPos{1, 1}, BitA{2});
+		std::atomic<int> seen{0};
+		World::view<ViewPos>().parallelEach([&](ent_type, ViewPos&) { ++seen; });
+		assert(seen == 1 && "Workers did not see the current registry");
+	}
+	assert(World::maxId().id == globalMax && "Scope did not restore the previous registry");
+
+	// registries sharing one pool: every chunk must run under its own job's registry
+	ThreadPool pool(3);
+	auto stress = [&pool](int tag, bool* ok) {
+		Registry registry;
+		Registry::Scope scope(registry);
+		vector<ent_type> ents(4096);
+		World::createEntities({ents.data(), 4096}, BitA{tag});
+		for (int round = 0; round < 500 && *ok; ++round) {
+			std::atomic<int> seen{0}, foreign{0};
+			World::view<BitA>().parallelEach([&](ent_type, BitA& a) {
+				++seen;
+				if (a.v != tag)
+					++foreign;
+			}, pool);
+			*ok = seen == 4096 && foreign == 0;
+		}
+	};
+	bool oks[4] = {true, true, true, true};
+	vector<thread> stressers;
+	for (int t = 0; t < 4; ++t)
+		stressers.emplace_back(stress, t + 10, &oks[t]);
+	for (thread& t : stressers)
+		t.join();
+	assert(oks[0] && oks[1] && oks[2] && oks[3] && "Chunk ran under another job's registry");
+	World::destroyEntity(outside);
+	cout << "Test 20 passed\n";
+}
+
+void test21() {
+	Registry registry;
+	Registry::Scope scope(registry);
+	vector<ent_type> ents(100);
+	World::createEntities({ents.data(), 100}, MemA{1});
+	for (int i = 0; i < 40; ++i)
+		World::addComponent(ents[i], MemB{0.5});
+	for (int i = 0; i < 10; ++i)
+		World::addComponent(ents[i], MemTag{});
+	for (int i = 0; i < 5; ++i)
+		World::addComponent(ents[i], ArchPos{1, 2});
+	for (int i = 10; i < 40; ++i)
+		World::delComponent<MemB>(ents[i]);
+
+	const MemoryReport r = World::memoryReport();
+	auto find = [&](const char* name) -> const MemoryStats* {
+		for (index_type i = 0; i < r.storages.size(); ++i)
+			if (strcmp(r.storages[i].name, name) == 0)
+				return &r.storages[i];
+		return nullptr;
+	};
+	const MemoryStats *a = find("MemA"), *b = find("MemB"), *tag = find("MemTag"), *arch = find("ArchPos");
+	assert(a && b && tag && arch && "Storage missing from the report");
+	assert(strcmp(a->kind, "sparse") == 0 && a->live == 100 && a->peak == 100 && a->capacity >= 100 && "Sparse stats wrong");
+	assert(strcmp(b->kind, "packed") == 0 && b->elemSize == sizeof(MemB) && b->live == 10 && b->peak == 40 && "Packed stats wrong");
+	assert(b->reserved < std::size_t(Params.InitialEntities) && "Packed bags reserved the whole entity range");
+	assert(strcmp(tag->kind, "tagged") == 0 && tag->live == 10 && tag->touched == 0 && "Tagged stats wrong");
+	assert(strcmp(arch->kind, "archetype") == 0 && arch->live == 5 && arch->capacity >= 5 && "Archetype stats wrong");
+	for (index_type i = 0; i < r.storages.size(); ++i)
+		assert(r.storages[i].reserved >= r.storages[i].touched && "Touched more than reserved");
+	assert(r.world.size() > 0 && r.world[0].live == 100 && r.touched() > 0 && r.reserved() >= r.touched() && "World tables wrong");
+	// BitB never had an entity here, so it has no bit plane yet
+	assert(World::bits(Component<BitB>::Index).size == 0 && World::view<BitB>().candidates() == 0 &&
+		"Unused component allocated a bit plane");
+	int kept = 0;
+	World::view<MemA>().exclude<BitB>().each([&](ent_type, MemA&) { ++kept; });
+	assert(kept == 100 && "Exclude of a component without a plane dropped entities");
+
+	std::FILE* f = std::tmpfile();
+	r.writeJson(f);
+	std::rewind(f);
+	char json[1 << 14] = {};
+	const size_t n = std::fread(json, 1, sizeof(json)-1, f);
+	std::fclose(f);
+	assert(n > 0 && json[0] == '{' && strstr(json, "\"name\": \"MemB\", \"kind\": \"packed\"") && "JSON not written");
+	cout << "Test 21 passed\n";
+}
+
+void test22() {
+	static_assert(std::is_same_v<Storage<MemTag>::type, TaggedStorage<MemTag>>, "Empty component not tagged");
+	static_assert(std::is_same_v<Storage<BitA>::type, SparseStorage<BitA>>, "Small component not sparse");
+	static_assert(std::is_same_v<Storage<BigBlob>::type, PackedStorage<BigBlob>>, "Large component not packed");
+
+	Entity a = Entity::create(), b = Entity::create();
+	a.addAll(BitA{1}, MemTag{}, BigBlob{{7}});
+	b.add(BitA{2});
+	int sum = 0;
+	World::view<BitA,MemTag>().each([&](ent_type, BitA& v, MemTag&) { sum += v.v; });
+	assert(sum == 1 && "View over a tag wrong");
+	assert(a.get<BigBlob>().bytes[0] == 7 && "Large component lost");
+
+	const char* path = "bagel_test_tags.bin";
+	assert(World::saveSnapshot(path) && "Tagged component blocked the snapshot");
+	a.del<MemTag>();
+	assert(World::loadSnapshot(path) && World::mask(a.entity()).test(Component<MemTag>::Bit) && "Tag not restored");
+	std::remove(path);
+	a.destroy();
+	b.destroy();
+	cout << "Test 22 passed\n";
+}
+
+void test23() {
+	static_assert(std::is_same_v<Storage<Flags>::type, BitStorage<Flags>>, "Bit width not honoured");
+	vector<ent_type> ents(130);
+	World::createEntities({ents.data(), 130});
+	for (int i = 0; i < 130; i += 2)
+		World::addComponent(ents[i], Flags{true, false, i % 4 == 0});
+	World::addComponent(ents[1], BitA{1});
+
+	const Flags f = World::getComponent<Flags>(ents[4]);
+	assert(f.a && !f.b && f.c && "Flags not stored");
+	World::getComponent<Flags>(ents[2]) = Flags{false, true, true};
+	const Flags& g = Entity(ents[2]).get<Flags>();
+	assert(!g.a && g.b && g.c && "Flags not written through the proxy");
+	int seen = 0;
+	World::view<Flags>().each([&](ent_type, const Flags& fl) { seen += fl.a; });
+	assert(seen == 64 && "View over flags wrong");
+
+	// clear flag a for every member in one pass over words
+	Span<word_type> a = BitStorage<Flags>::plane(0);
+	for (index_type w = 0; w < a.size; ++w)
+		a[w] &= ~World::bitWord(Component<Flags>::Index, w);
+	World::getComponent<Flags>(ents[128]) = Flags{true, true, true};
+	World::delComponent<Flags>(ents[128]);
+	for (int i = 0; i < 130; i += 2)
+		assert(!Flags(World::getComponent<Flags>(ents[i])).a && "Bulk clear missed a member");
+	assert(!Flags(World::getComponent<Flags>(ents[128])).b && "Removed component left its bits");
+	assert(World::getComponent<BitA>(ents[1]).v == 1 && "Neighbour component touched");
+
+	for (ent_type e : ents)
+		World::destroyEntity(e);
+	cout << "Test 23 passed\n";
+}
+
+void test24() {
+	vector<ent_type> ents(2000);
+	World::createEntities({ents.data(), 2000});
+	for (int i = 0; i < 2000; i += 3)
+		World::addComponent(ents[i], Rare{i});
+	for (int i = 0; i < 2000; i += 9)
+		World::delComponent<Rare>(ents[i]);
+	for (int i = 0; i < 2000; ++i) {
+		const bool expected = i % 3 == 0 && i % 9 != 0;
+		assert(HashStorage<Rare>::has(ents[i]) == expected && "Hash membership wrong");
+		if (expected)
+			assert(World::getComponent<Rare>(ents[i]).v == i && "Hash value lost");
+	}
+	assert(HashStorage<Rare>::size() == 667 - 223 && "Hash size wrong");
+	int seen = 0;
+	World::view<Rare>().each([&](ent_type e, Rare& r) { seen += ents[r.v].id == e.id; });
+	assert(seen == 444 && "View over hash storage wrong");
+
+	for (int i = 1; i < 100; i += 3)
+		World::addComponent(ents[i], RareList{{i, i+1}});
+	World::delComponent<RareList>(ents[1]);
+	assert(World::getComponent<RareList>(ents[97]).items[1] == 98 && "Non trivially copyable value lost");
+
+	for (ent_type e : ents)
+		World::destroyEntity(e);
+	assert(HashStorage<Rare>::size() == 0 && HashStorage<RareList>::size() == 0 && "Destroy left hash entries");
+	cout << "Test 24 passed\n";
+}
+
+void test25() {
+	const ent_type old = World::createEntity();
+	World::addComponent(old, BitA{1});
+	World::destroyEntity(old);
+	const ent_type reused = World::createEntity();
+	assert(reused.id == old.id && reused.gen != old.gen && "Recycled id kept its generation");
+	assert(!World::valid(old) && World::valid(reused) && "Stale handle not detected");
+	World::addComponent(reused, BitA{2});
+	World::destroyEntity(old);
+	assert(World::valid(reused) && World::getComponent<BitA>(reused).v == 2 && "Stale destroy hit the new entity");
+
+	CommandBuffer cmds;
+	cmds.add(reused, RareList{{5}});
+	cmds.destroy(reused);
+	World::destroyEntity(reused);
+	const ent_type third = World::createEntity();
+	cmds.playback();
+	assert(third.id == reused.id && World::valid(third) && World::mask(third) == Mask{} && "Deferred commands hit a recycled id");
+
+	World::addComponent(third, ViewPos{0, 0});
+	bool seen = false;
+	World::view<ViewPos>().each([&](ent_type e, ViewPos&) { seen = seen || (e.id == third.id && e.gen == third.gen); });
+	for (ent_type e : World::view<BitA>())
+		assert(World::valid(e) && "View yielded a stale handle");
+	assert(seen && World::entity(third.id).gen == third.gen && "Iteration lost the generation");
+	World::destroyEntity(third);
+
+	ent_type stale[2] = {World::createEntity(), World::createEntity()};
+	World::addComponent(stale[0], ViewPos{1, 1});
+	World::destroyEntity(stale[0]);
+	const ent_type live = World::createEntity();
+	World::addComponent(live, ViewPos{2, 2});
+	World::destroyEntities({stale, 2});
+	assert(World::valid(live) && !World::valid(stale[1]) && "Stale handle in a batch destroyed a live entity");
+	int visits = 0;
+	World::view<ViewPos>().changed<ViewPos>().each([&](ent_type e, ViewPos&) {
+		assert(World::valid(e) && "Changed list yielded a stale handle");
+		visits += e.id == live.id;
+	});
+	assert(live.id == stale[0].id && visits == 1 && "Recycled entity visited twice");
+	World::destroyEntity(live);
+	cout << "Test 25 passed\n";
+}
+
 void run_tests()
 {
 	test1();
+	test2();
+	test3();
+	test4();
+	test5();
+	test6();
+	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
+}
+
+// exits with 0 only if creating an entity past the last id aborts
+int test_id_overflow()
+{
+	static_assert(sizeof(id_type)*8 == Params.IdBits && sizeof(ent_type) == 2*sizeof(id_type) &&
+		sizeof(slot_type) == sizeof(id_type), "Stored ids not narrowed to Params.IdBits");
+	signal(SIGABRT, [](int) { _Exit(0); });
+	vector<ent_type> ents(size_t(numeric_limits<id_type>::max()) + 1);
+	World::createEntities({ents.data(), size_type(ents.size())});
+	assert(World::maxId().id == numeric_limits<id_type>::max() && "Last id not handed out");
+	World::createEntity();
+	return 1;
+}
+
+#ifdef BAGEL_TESTS_MAIN
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "overflow") == 0)
+		return test_id_overflow();
+	run_tests();
 }
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+
+// BAGEL_TESTS and BAGEL_LIST_CLASH also cover change tracking, which the game leaves off
+constexpr Bagel Params{
+	.ChangeTracking = true,
+	.DynamicResize = true,
+	.VirtualMemory = true
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+// BAGEL_TESTS16 runs the tests again with 16-bit ids
+constexpr Bagel Params{
+	.ChangeTracking = true,
+	.DynamicResize = true,
+	.VirtualMemory = true,
+	.InitialEntities = 30000,
+	.IdBits = 16
+};
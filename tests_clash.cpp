@@ -0,0 +1,23 @@
+// a second BAGEL_COMPONENTS list next to the one in tests.cpp: both number
+// their components from 0, so storage registration must abort. That happens
+// during static initialization, so the handler is installed before it
+#include <csignal>
+#include <cstdlib>
+#include "bagel.h"
+
+struct ClashHandler {
+	ClashHandler() { std::signal(SIGABRT, [](int) { std::_Exit(0); }); }
+};
+static ClashHandler handler __attribute__((init_priority(101)));
+
+struct ClashA { int v; };
+struct ClashB { float x; };
+using ClashComponents = bagel::Components<ClashA, ClashB>;
+BAGEL_COMPONENTS(ClashComponents);
+
+int main()
+{
+	const bagel::ent_type e = bagel::World::createEntity();
+	bagel::World::addComponents(e, ClashA{1}, ClashB{2});
+	return 1;
+}
@@ -0,0 +1,7 @@
+// a second translation unit: unlisted components registered here must not
+// share indices with the ones registered in tests.cpp
+#include "bagel.h"
+
+struct OtherUnit { int v; };
+
+bagel::index_type otherUnitIndex() { return bagel::componentIndex<OtherUnit>(); }